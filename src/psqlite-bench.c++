@@ -0,0 +1,426 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+/* Measures the throughput and latency of every connection operation,
+ * across a range of table shapes.  Every measurement is printed as a
+ * single line of JSON, so the output of two releases can be compared
+ * mechanically. */
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <psqlite/connection.h++>
+#include <psqlite/connection_pool.h++>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/* One point in the benchmark's parameter space. */
+struct config {
+    bool memory;
+    size_t rows;
+    size_t columns;
+    size_t value_size;
+    size_t threads;
+    size_t ops;
+};
+
+typedef std::chrono::steady_clock bench_clock;
+
+/* Splits a comma-separated list of numbers. */
+static std::vector<size_t> parse_list(const char *str);
+
+/* Runs every benchmark against a single configuration. */
+static void run_config(const config& c);
+
+/* Runs "op" "count" times, printing a single line of results. */
+static void measure(const config& c,
+                    const std::string& name,
+                    size_t count,
+                    std::function<void(size_t)> op);
+
+/* Prints a single line of results from a list of latencies, which
+ * are in nanoseconds. */
+static void report(const config& c,
+                   const std::string& name,
+                   size_t ops,
+                   double seconds,
+                   std::vector<int64_t>& latencies);
+
+/* Builds the rows that get inserted into the test table. */
+static psqlite::row::ptr make_row(const config& c, size_t i);
+static std::string make_key(size_t i);
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "%s: benchmark psqlite operations\n", argv0);
+    fprintf(stderr, "  --db memory,file    database types to test\n");
+    fprintf(stderr, "  --rows N,...        rows in the test table\n");
+    fprintf(stderr, "  --columns N,...     columns in the test table\n");
+    fprintf(stderr, "  --value-size N,...  bytes in every value\n");
+    fprintf(stderr, "  --threads N,...     concurrent reader threads\n");
+    fprintf(stderr, "  --ops N             operations per measurement\n");
+}
+
+int main(int argc, const char **argv)
+{
+    std::vector<bool> dbs = {true, false};
+    std::vector<size_t> rows = {1000, 10000};
+    std::vector<size_t> columns = {2, 8};
+    std::vector<size_t> value_sizes = {16, 1024};
+    std::vector<size_t> threads = {1, 4};
+    size_t ops = 1000;
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+
+        if (strcmp(argv[i], "--db") == 0) {
+            dbs.clear();
+            if (strstr(argv[i+1], "memory") != NULL)
+                dbs.push_back(true);
+            if (strstr(argv[i+1], "file") != NULL)
+                dbs.push_back(false);
+        } else if (strcmp(argv[i], "--rows") == 0) {
+            rows = parse_list(argv[i+1]);
+        } else if (strcmp(argv[i], "--columns") == 0) {
+            columns = parse_list(argv[i+1]);
+        } else if (strcmp(argv[i], "--value-size") == 0) {
+            value_sizes = parse_list(argv[i+1]);
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            threads = parse_list(argv[i+1]);
+        } else if (strcmp(argv[i], "--ops") == 0) {
+            ops = atol(argv[i+1]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    /* Every operation picks rows at random, so there have to be some
+     * rows to pick from. */
+    if (ops == 0 || std::find(rows.begin(), rows.end(), 0) != rows.end()) {
+        fprintf(stderr, "%s: --rows and --ops must be at least 1\n", argv[0]);
+        return 1;
+    }
+
+    for (const auto& memory: dbs)
+        for (const auto& row_count: rows)
+            for (const auto& column_count: columns)
+                for (const auto& value_size: value_sizes)
+                    for (const auto& thread_count: threads) {
+                        /* Every thread in the pool needs its own
+                         * connection to the same database, which
+                         * isn't possible with ":memory:". */
+                        if (memory == true && thread_count > 1)
+                            continue;
+
+                        /* Every table needs at least a key and a
+                         * value. */
+                        config c;
+                        c.memory = memory;
+                        c.rows = row_count;
+                        c.columns = std::max<size_t>(column_count, 2);
+                        c.value_size = value_size;
+                        c.threads = thread_count;
+                        c.ops = std::min(ops, row_count);
+
+                        /* Every configuration runs in its own process,
+                         * so the peak RSS that gets reported is just
+                         * its own and not the largest one so far. */
+                        fflush(stdout);
+                        pid_t pid = fork();
+                        if (pid < 0) {
+                            perror("Unable to fork");
+                            abort();
+                        }
+                        if (pid == 0) {
+                            run_config(c);
+                            fflush(stdout);
+                            _exit(0);
+                        }
+
+                        int status;
+                        if (waitpid(pid, &status, 0) < 0
+                            || !WIFEXITED(status)
+                            || WEXITSTATUS(status) != 0) {
+                            fprintf(stderr, "Benchmark process failed\n");
+                            return 1;
+                        }
+                    }
+
+    return 0;
+}
+
+std::vector<size_t> parse_list(const char *str)
+{
+    std::vector<size_t> out;
+    while (*str != '\0') {
+        char *end;
+        out.push_back(strtoul(str, &end, 10));
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            break;
+        str = end;
+    }
+    return out;
+}
+
+void run_config(const config& c)
+{
+    /* File databases live in a temporary directory that's cleaned
+     * up afterwards, along with SQLite's journal files. */
+    std::string path = ":memory:";
+    char dir[] = "/tmp/psqlite-bench-XXXXXX";
+    if (c.memory == false) {
+        if (mkdtemp(dir) == NULL) {
+            perror("Unable to create temporary directory");
+            abort();
+        }
+        path = std::string(dir) + "/bench.db";
+    }
+
+    std::vector<psqlite::column::ptr> columns;
+    for (size_t i = 0; i < c.columns; ++i) {
+        auto name = "c" + std::to_string(i);
+        columns.push_back(std::make_shared<psqlite::column_t<std::string>>(name));
+    }
+    auto table = std::make_shared<psqlite::table>("bench", columns);
+
+    /* Every benchmark works on a random set of keys, but it's the same
+     * random set every time. */
+    std::mt19937 rng(0);
+    std::vector<size_t> keys(c.ops);
+    for (auto& key: keys)
+        key = rng() % c.rows;
+
+    std::vector<psqlite::row::ptr> rows;
+    for (size_t i = 0; i < c.rows; ++i)
+        rows.push_back(make_row(c, i));
+
+    /* Every ":memory:" connection gets its own database, so this one
+     * connection has to be used for everything. */
+    auto db = std::make_shared<psqlite::connection>(path);
+    if (c.memory == false)
+        db->enable_wal();
+
+    measure(c, "create", 1,
+            [&](size_t) { db->create(table); });
+
+    /* Up to half of the rows are inserted one at a time, and the
+     * rest all at once, so both always have something to do. */
+    size_t singles = std::min(c.ops, c.rows / 2);
+    if (singles > 0) {
+        measure(c, "insert", singles,
+                [&](size_t i) { db->insert(table, rows[i]); });
+    }
+
+    {
+        std::vector<psqlite::row::ptr> rest(rows.begin() + singles,
+                                            rows.end());
+        auto start = bench_clock::now();
+        db->insert_many(table, rest);
+        auto end = bench_clock::now();
+
+        std::vector<int64_t> latencies = {
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()
+        };
+        report(c, "insert_many", rest.size(),
+               std::chrono::duration<double>(end - start).count(),
+               latencies);
+    }
+
+    /* An empty transaction never has to sync anything, so every
+     * one writes a single row to make the commit cost something. */
+    measure(c, "transaction", c.ops,
+            [&](size_t i) {
+                auto tr = db->immediate_transaction();
+                db->replace(table, rows[keys[i]], "c0='%s'",
+                            make_key(keys[i]).c_str());
+            });
+
+    if (c.threads == 1) {
+        measure(c, "select", c.ops,
+                [&](size_t i) {
+                    db->select(table, "c0='%s'",
+                               make_key(keys[i]).c_str());
+                });
+    }
+
+    measure(c, "select_all", 10,
+            [&](size_t) { db->select(table); });
+
+    measure(c, "scan", 10,
+            [&](size_t) {
+                for (const auto& row: db->scan(table))
+                    (void)row;
+            });
+
+    measure(c, "count", c.ops,
+            [&](size_t i) {
+                db->count(table, "c0='%s'", make_key(keys[i]).c_str());
+            });
+
+    measure(c, "replace", c.ops,
+            [&](size_t i) {
+                db->replace(table, rows[keys[i]], "c0='%s'",
+                            make_key(keys[i]).c_str());
+            });
+
+    {
+        std::vector<psqlite::row::ptr> batch;
+        for (const auto& key: keys)
+            batch.push_back(rows[key]);
+
+        auto start = bench_clock::now();
+        db->replace_many(table, batch, {"c0"});
+        auto end = bench_clock::now();
+
+        std::vector<int64_t> latencies = {
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()
+        };
+        report(c, "replace_many", batch.size(),
+               std::chrono::duration<double>(end - start).count(),
+               latencies);
+    }
+
+    measure(c, "clear", c.ops,
+            [&](size_t i) {
+                db->clear(table, {"c1"}, "c0='%s'",
+                          make_key(keys[i]).c_str());
+            });
+
+    /* Concurrent readers need a pool, which only makes sense for
+     * file-backed databases. */
+    if (c.threads > 1) {
+        auto pool = std::make_shared<psqlite::connection_pool>(path, c.threads);
+
+        std::vector<std::vector<int64_t>> latencies(c.threads);
+        std::vector<std::thread> threads;
+        auto start = bench_clock::now();
+        for (size_t t = 0; t < c.threads; ++t) {
+            threads.push_back(std::thread([&, t](void) {
+                        auto reader = pool->reader();
+                        for (size_t i = t; i < c.ops; i += c.threads) {
+                            auto op_start = bench_clock::now();
+                            reader->select(table, "c0='%s'",
+                                       make_key(keys[i]).c_str());
+                            auto op_end = bench_clock::now();
+                            latencies[t].push_back(
+                                std::chrono::duration_cast<std::chrono::nanoseconds>(op_end - op_start).count());
+                        }
+                    }));
+        }
+        for (auto& thread: threads)
+            thread.join();
+        auto end = bench_clock::now();
+
+        std::vector<int64_t> all;
+        for (const auto& l: latencies)
+            all.insert(all.end(), l.begin(), l.end());
+        report(c, "select", c.ops,
+               std::chrono::duration<double>(end - start).count(),
+               all);
+    }
+
+    /* Removing rows goes last, as it destroys the table. */
+    measure(c, "remove", c.ops,
+            [&](size_t i) {
+                db->remove(table, "c0='%s'", make_key(keys[i]).c_str());
+            });
+    db = NULL;
+
+    if (c.memory == false) {
+        for (const auto& suffix: {"", "-wal", "-shm"})
+            unlink((path + suffix).c_str());
+        rmdir(dir);
+    }
+}
+
+void measure(const config& c,
+             const std::string& name,
+             size_t count,
+             std::function<void(size_t)> op)
+{
+    std::vector<int64_t> latencies;
+    latencies.reserve(count);
+
+    auto start = bench_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        auto op_start = bench_clock::now();
+        op(i);
+        auto op_end = bench_clock::now();
+        latencies.push_back(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(op_end - op_start).count());
+    }
+    auto end = bench_clock::now();
+
+    report(c, name, count,
+           std::chrono::duration<double>(end - start).count(),
+           latencies);
+}
+
+void report(const config& c,
+            const std::string& name,
+            size_t ops,
+            double seconds,
+            std::vector<int64_t>& latencies)
+{
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) -> double
+        {
+            if (latencies.size() == 0)
+                return 0;
+            size_t i = p * (latencies.size() - 1);
+            return latencies[i] / 1000.0;
+        };
+
+    /* Linux reports this in kilobytes. */
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("{\"op\": \"%s\", \"db\": \"%s\", \"rows\": %lu, \"columns\": %lu, "
+           "\"value_size\": %lu, \"threads\": %lu, \"ops\": %lu, "
+           "\"ops_per_sec\": %.1f, \"p50_us\": %.3f, \"p90_us\": %.3f, "
+           "\"p99_us\": %.3f, \"max_us\": %.3f, \"peak_rss_kb\": %ld}\n",
+           name.c_str(),
+           c.memory ? "memory" : "file",
+           (unsigned long)c.rows,
+           (unsigned long)c.columns,
+           (unsigned long)c.value_size,
+           (unsigned long)c.threads,
+           (unsigned long)ops,
+           (seconds > 0) ? ops / seconds : 0.0,
+           percentile(0.50),
+           percentile(0.90),
+           percentile(0.99),
+           percentile(1.00),
+           usage.ru_maxrss);
+    fflush(stdout);
+}
+
+psqlite::row::ptr make_row(const config& c, size_t i)
+{
+    std::map<std::string, std::string> m;
+    m["c0"] = make_key(i);
+    for (size_t j = 1; j < c.columns; ++j)
+        m["c" + std::to_string(j)] = std::string(c.value_size, 'a' + (j % 26));
+    return std::make_shared<psqlite::row>(m);
+}
+
+std::string make_key(size_t i)
+{
+    return "key" + std::to_string(i);
+}
@@ -0,0 +1,48 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#include "arena.h++"
+#include <string.h>
+using namespace psqlite;
+
+arena::arena(size_t block_size)
+    : _blocks(),
+      _used(block_size),
+      _block_size(block_size)
+{
+}
+
+const char *arena::copy(const char *data, size_t size)
+{
+    /* Large values get a block of their own, which is inserted
+     * behind the current block so the space left in it can still
+     * be used. */
+    if (size + 1 > _block_size / 4) {
+        std::unique_ptr<char[]> block(new char[size + 1]);
+        if (size != 0)
+            memcpy(block.get(), data, size);
+        block[size] = '\0';
+        auto out = block.get();
+        _blocks.insert(_blocks.end() - (_blocks.empty() ? 0 : 1),
+                       std::move(block));
+        return out;
+    }
+
+    if (_used + size + 1 > _block_size) {
+        _blocks.push_back(std::unique_ptr<char[]>(new char[_block_size]));
+        _used = 0;
+    }
+
+    char *out = _blocks.back().get() + _used;
+    if (size != 0)
+        memcpy(out, data, size);
+    out[size] = '\0';
+    _used += size + 1;
+    return out;
+}
+
+void arena::clear(void)
+{
+    _blocks.clear();
+    _used = _block_size;
+}
@@ -0,0 +1,35 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#ifndef PSQLITE__ARENA_HXX
+#define PSQLITE__ARENA_HXX
+
+#include <memory>
+#include <stdlib.h>
+#include <vector>
+
+namespace psqlite {
+    /* A simple bump allocator for the text and blob data in a set
+     * of rows, which avoids a separate heap allocation for every
+     * single value.  Nothing is freed until the whole arena is. */
+    class arena {
+    private:
+        std::vector<std::unique_ptr<char[]>> _blocks;
+        size_t _used;
+        size_t _block_size;
+
+    public:
+        arena(size_t block_size = 4096);
+
+    public:
+        /* Copies the given bytes into the arena, returning a
+         * pointer to the (NUL-terminated) copy that stays valid
+         * until the arena is cleared. */
+        const char *copy(const char *data, size_t size);
+
+        /* Frees everything in the arena. */
+        void clear(void);
+    };
+}
+
+#endif
@@ -5,9 +5,27 @@
 #define PSQLITE__COLUMN_HXX
 
 #include <memory>
+#include <stdint.h>
 #include <string>
+#include <vector>
 
 namespace psqlite {
+    /* Constraints that can be placed on a column, which can be
+     * OR'd together.  When more than one column in a table is
+     * marked as the primary key they form a single composite
+     * key.  COLUMN_TYPED declares the column's SQL type from its
+     * C++ type (see sql_type), which means SQLite converts values
+     * to that type when storing them: for example "1.50" reads
+     * back as "1.5" from a REAL column.  Columns are untyped
+     * otherwise, so whatever was stored is read back exactly. */
+    enum column_flags {
+        COLUMN_NONE = 0,
+        COLUMN_PRIMARY_KEY = 1,
+        COLUMN_UNIQUE = 2,
+        COLUMN_NOT_NULL = 4,
+        COLUMN_TYPED = 8,
+    };
+
     /* Represents a single SQLite column.  */
     class column {
     public:
@@ -15,24 +33,89 @@ namespace psqlite {
             
     private:
         const std::string _name;
+        const std::string _type;
+        const unsigned _flags;
 
     public:
         column(const std::string& name)
-            : _name(name)
+            : _name(name),
+              _type(""),
+              _flags(COLUMN_NONE)
+            {
+            }
+
+        column(const std::string& name,
+               const std::string& type,
+               unsigned flags)
+            : _name(name),
+              _type(type),
+              _flags(flags)
             {
             }
 
     public:
         const std::string& name(void) const
             { return _name; }
+
+        /* The column's declared SQL type, which is empty for
+         * columns that don't have one. */
+        const std::string& type(void) const
+            { return _type; }
+
+        unsigned flags(void) const
+            { return _flags; }
+        bool primary_key(void) const
+            { return (_flags & COLUMN_PRIMARY_KEY) != 0; }
+        bool unique(void) const
+            { return (_flags & COLUMN_UNIQUE) != 0; }
+        bool not_null(void) const
+            { return (_flags & COLUMN_NOT_NULL) != 0; }
+    };
+
+    /* Maps a C++ type to the SQL type that it's stored as, which
+     * mostly matters because SQLite converts values to match the
+     * column's type before comparing them.  Unsigned 64-bit types
+     * aren't mapped, as SQLite can't store integers above
+     * INT64_MAX and would turn them into (lossy) REALs. */
+    template<class T> struct sql_type {
+        static const char *name(void) { return ""; }
+    };
+    template<> struct sql_type<std::string> {
+        static const char *name(void) { return "TEXT"; }
+    };
+    template<> struct sql_type<std::vector<uint8_t>> {
+        static const char *name(void) { return "BLOB"; }
+    };
+    template<> struct sql_type<double> {
+        static const char *name(void) { return "REAL"; }
+    };
+    template<> struct sql_type<float> {
+        static const char *name(void) { return "REAL"; }
+    };
+    template<> struct sql_type<bool> {
+        static const char *name(void) { return "INTEGER"; }
+    };
+    template<> struct sql_type<int> {
+        static const char *name(void) { return "INTEGER"; }
+    };
+    template<> struct sql_type<unsigned> {
+        static const char *name(void) { return "INTEGER"; }
+    };
+    template<> struct sql_type<long> {
+        static const char *name(void) { return "INTEGER"; }
+    };
+    template<> struct sql_type<long long> {
+        static const char *name(void) { return "INTEGER"; }
     };
 
     /* Represents a singel SQLite column type, which is actually
      * capable of casting things around. */
     template<class T> class column_t: public column {
     public:
-        column_t(const std::string& name)
-            : column(name)
+        column_t(const std::string& name, unsigned flags = COLUMN_NONE)
+            : column(name,
+                     (flags & COLUMN_TYPED) ? sql_type<T>::name() : "",
+                     flags)
             {
             }
         
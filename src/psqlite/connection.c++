@@ -2,35 +2,85 @@
 /* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
 
 #include "connection.h++"
-#include <iterator>
-#include <map>
-#include <sstream>
+#include <algorithm>
 #include <stdarg.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 using namespace psqlite;
 
-#ifndef BUFFER_SIZE
-#define BUFFER_SIZE 1024
+#ifndef STATEMENT_CACHE_SIZE
+#define STATEMENT_CACHE_SIZE 64
 #endif
 
-/* SQLite uses a callback for enumerating results, but unfortunately
- * this requires that you use C function pointers instead of C++
- * std::function.  Thus I have to do the whole struct/wrapper thing
- * here... :(. */
-struct sqlite3_exec_args {
-    result::ptr result_ptr;
+#ifndef RESULT_CACHE_SIZE
+#define RESULT_CACHE_SIZE 256
+#endif
+
+#ifndef RESULT_CACHE_ROWS
+#define RESULT_CACHE_ROWS 1024
+#endif
+
+/* The WHERE clause used when a query should match every row. */
+#define ALL_ROWS "'true'='true'"
+
+/* The different sorts of printf-style arguments that can be turned
+ * into SQLite parameters. */
+enum class where_arg {
+    INT,
+    UINT,
+    LONG,
+    ULONG,
+    LLONG,
+    ULLONG,
+    SIZE,
+    DOUBLE,
+    STRING,
+    CHAR,
 };
-static int sqlite3_exec_func(void *args,
-                             int count,
-                             char **data,
-                             char **names);
+
+/* Parses a single printf-style conversion, returning its length (or
+ * 0 if it's not one that can be bound as a parameter). */
+static size_t parse_conversion(const char *p, where_arg *arg);
+
+/* Walks a printf-style WHERE clause, calling "text" for every
+ * literal character and "arg" for every conversion.  Returns false
+ * if the format can't be expressed using bound parameters, which
+ * happens for conversions that aren't quoted strings or numbers --
+ * for example, a bare "%s" is allowed to expand to arbitrary SQL. */
+template<class T, class A>
+static bool walk_where(const char *format, T text, A arg);
+
+/* Binds one argument to the given statement. */
+static void bind_arg(const statement::ptr& stmt,
+                     int index,
+                     const char *spec,
+                     size_t length,
+                     where_arg arg,
+                     bool quoted,
+                     va_list *args);
 
 connection::connection(const std::string& db_path)
+    : connection(db_path, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE)
+{
+}
+
+connection::connection(const std::string& db_path, int flags)
     : _db(NULL),
-      _tr(std::shared_ptr<transaction>(NULL))
+      _tr(std::shared_ptr<transaction>(NULL)),
+      _stmts(STATEMENT_CACHE_SIZE),
+      _results(RESULT_CACHE_SIZE, RESULT_CACHE_ROWS),
+      _data_version(-1),
+      _self(),
+      _plan_check(plan_check::NONE),
+      _planned(),
+      _busy_handler(),
+      _busy_timeout(1000),
+      _instrument(NULL),
+      _tr_start(),
+      _tr_timed(false)
 {
-    int err = sqlite3_open(db_path.c_str(), &_db);
+    int err = sqlite3_open_v2(db_path.c_str(), &_db, flags, NULL);
     if (err != SQLITE_OK) {
         perror("Unable t open sqlite database");
         fprintf(stderr, "  database path:'%s'\n", db_path.c_str());
@@ -38,17 +88,18 @@ connection::connection(const std::string& db_path)
         abort();
     }
 
-    sqlite3_busy_timeout(_db, 1000);
+    update_busy_handler();
 }
 
 connection::~connection(void)
 {
-    sqlite3_close(_db);
+    _stmts.clear();
+    sqlite3_close_v2(_db);
 }
 
 result::ptr connection::select(const table::ptr& table)
 {
-    return select(table, "'true'='true'");
+    return select(table, ALL_ROWS);
 }
 
 
@@ -73,84 +124,59 @@ result::ptr connection::select(const table::ptr& table,
                                const char *format,
                                va_list args)
 {
-    /* It turns out that SQLite provides a mechanism for eliminating
-     * SQL injection attacks, but it conflicts with GCC's printf-like
-     * format string checker.  Thus I work around the problem by
-     * simply converting everything to injection-proof right here. */
-    char *nformat = new char[strlen(format) + 1];
-    strcpy(nformat, format);
-    for (size_t i = 0; i < strlen(nformat); ++i)
-        if (strncmp(nformat + i, "%s",  2) == 0)
-            nformat[i+1] = 'q';
-
-    /* Here we format the string to avoid injection attacks. */
-    va_list sargs; va_copy(sargs, args);
-    char test_args[2];
-    size_t query_length = vsnprintf(test_args, 2, format, sargs) + 1;
-    char *query = new char[query_length];
-    sqlite3_vsnprintf(query_length, query, nformat, args);
-
-    /* That's not the whole SQL command, we also need the "SELECT (...)
-     * FROM ..." part.  */
-    size_t column_length = 2;
-    for (const auto& column: c)
-        column_length += strlen(column->name().c_str()) + 2;
-    char *column_spec = new char[column_length];
-    column_spec[0] = '\0';
-    for (const auto& column: c) {
-        strcat(column_spec, column->name().c_str());
-        strcat(column_spec, ", ");
-    }
-    column_spec[strlen(column_spec)-2] = '\0';
-
-    /* Now we can assemble the final SQL query string. */
-    size_t command_length =
-        strlen("SELECT ")
-        + strlen(column_spec)
-        + strlen(" FROM ")
-        + strlen(table->name().c_str())
-        + strlen(" WHERE ")
-        + strlen(query)
-        + 2;
-    char *command = new char[command_length];
-    sprintf(command, "SELECT %s FROM %s WHERE %s;",
-            column_spec,
-            table->name().c_str(),
-            query);
-#ifdef DEBUG_SQLITE_COMMANDS
-    fprintf(stderr, "command: '%s'\n", command);
-#endif
+    auto stmt = prepare_select(table, c, format, args);
+    if (stmt == NULL)
+        return error_result();
 
-    /* SQLite fills out an argument pointer, so we need one
-     * created. */
-    auto out = std::make_shared<result>();
+    return execute_cached(table, stmt);
+}
 
-    /* At this point the SQL query can actually be run. */
-    {
-        struct sqlite3_exec_args args;
-        char *error_string = NULL;
-        args.result_ptr = out;
-        int error = sqlite3_exec(_db,
-                                 command,
-                                 &sqlite3_exec_func,
-                                 &args,
-                                 &error_string);
-        if (error_string == NULL)
-            error_string = (char *)"";
-        out->set_error(error, error_string);
-    }
-
-    /* Finally we can clean up those allocated strings and return! */
-    delete[] nformat;
-    delete[] query;
-    delete[] column_spec;
-    delete[] command;
+cursor::ptr connection::scan(const table::ptr& table)
+{
+    return scan(table, ALL_ROWS);
+}
+
+cursor::ptr connection::scan(const table::ptr& table,
+                             const char *format, ...)
+{
+    va_list args; va_start(args, format);
+    auto out = scan(table, format, args);
+    va_end(args);
     return out;
 }
 
+cursor::ptr connection::scan(const table::ptr& table,
+                             const char *format,
+                             va_list args)
+{
+    return scan(table, table->columns(), format, args);
+}
+
+cursor::ptr connection::scan(const table::ptr& table,
+                             const std::vector<column::ptr>& c,
+                             const char *format, ...)
+{
+    va_list args; va_start(args, format);
+    auto out = scan(table, c, format, args);
+    va_end(args);
+    return out;
+}
+
+cursor::ptr connection::scan(const table::ptr& table,
+                             const std::vector<column::ptr>& c,
+                             const char *format,
+                             va_list args)
+{
+    auto stmt = prepare_select(table, c, format, args);
+    if (stmt == NULL)
+        return std::make_shared<cursor>(this, error_result());
+
+    return std::make_shared<cursor>(this, stmt);
+}
+
 result::ptr connection::count(const table::ptr& table)
 {
-    return count(table, "'true'='true'");
+    return count(table, ALL_ROWS);
 }
 
 
@@ -175,132 +201,73 @@ result::ptr connection::count(const table::ptr& table,
                               const char *format,
                               va_list args)
 {
-    /* It turns out that SQLite provides a mechanism for eliminating
-     * SQL injection attacks, but it conflicts with GCC's printf-like
-     * format string checker.  Thus I work around the problem by
-     * simply converting everything to injection-proof right here. */
-    char *nformat = new char[strlen(format) + 1];
-    strcpy(nformat, format);
-    for (size_t i = 0; i < strlen(nformat); ++i)
-        if (strncmp(nformat + i, "%s",  2) == 0)
-            nformat[i+1] = 'q';
-
-    /* Here we format the string to avoid injection attacks. */
-    va_list sargs; va_copy(sargs, args);
-    char test_args[2];
-    size_t query_length = vsnprintf(test_args, 2, format, sargs) + 1;
-    char *query = new char[query_length];
-    sqlite3_vsnprintf(query_length, query, nformat, args);
-
-    /* That's not the whole SQL command, we also need the "SELECT (...)
-     * FROM ..." part.  */
-    size_t column_length = 2;
-    for (const auto& column: c)
-        column_length += strlen("COUNT( ),  ") + strlen(column->name().c_str());
-    char *column_spec = new char[column_length];
-    column_spec[0] = '\0';
-    for (const auto& column: c) {
-        strcat(column_spec, "COUNT(");
-        strcat(column_spec, column->name().c_str());
-        strcat(column_spec, "), ");
-    }
-    column_spec[strlen(column_spec)-2] = '\0';
-
-    /* Now we can assemble the final SQL query string. */
-    size_t command_length =
-        strlen("SELECT ")
-        + strlen(column_spec)
-        + strlen(" FROM ")
-        + strlen(table->name().c_str())
-        + strlen(" WHERE ")
-        + strlen(query)
-        + 2;
-    char *command = new char[command_length];
-    sprintf(command, "SELECT %s FROM %s WHERE %s;",
-            column_spec,
-            table->name().c_str(),
-            query);
-#ifdef DEBUG_SQLITE_COMMANDS
-    fprintf(stderr, "command: '%s'\n", command);
-#endif
+    std::string command = "SELECT ";
+    for (size_t i = 0; i < c.size(); ++i) {
+        if (i != 0)
+            command += ", ";
+        command += "COUNT(" + c[i]->name() + ")";
+    }
+    command += " FROM " + table->name() + " WHERE ";
 
-    /* SQLite fills out an argument pointer, so we need one
-     * created. */
-    auto out = std::make_shared<result>();
+    auto stmt = prepare_where(command, 1, format, args);
+    if (stmt == NULL)
+        return error_result();
 
-    /* At this point the SQL query can actually be run. */
-    {
-        struct sqlite3_exec_args args;
-        char *error_string = NULL;
-        args.result_ptr = out;
-        int error = sqlite3_exec(_db,
-                                 command,
-                                 &sqlite3_exec_func,
-                                 &args,
-                                 &error_string);
-        if (error_string == NULL)
-            error_string = (char *)"";
-        out->set_error(error, error_string);
-    }
-
-    /* Finally we can clean up those allocated strings and return! */
-    delete[] nformat;
-    delete[] query;
-    delete[] column_spec;
-    delete[] command;
-    return out;
+    return execute_cached(table, stmt);
 }
 
 result::ptr connection::insert(const table::ptr& table,
                                               const row::ptr& row)
 {
-    std::string command = "INSERT INTO " + table->name() + " (";
-    for (const auto& column: row->columns()) {
-        auto format = new char[column.size() + 10];
-        sqlite3_snprintf(column.size() + 10,
-                         format, "%s",
-                         column.c_str()
-            );
-        command = command + format + ", ";
-        delete[] format;
-    }
-    command.replace(strlen(command.c_str())-2, 1, "\0");
-    command = command + ") VALUES (";
-    for (const auto& column: row->columns()) {
-        auto format = new char[row->value(column).size() + 10];
-        sqlite3_snprintf(row->value(column).size() + 10,
-                         format, "'%q'",
-                         row->value(column).c_str());
-        command = command + format + ", ";
-        delete[] format;
-    }
-    command.replace(strlen(command.c_str())-2, 1, "\0");
-    command = command + ")";
+    auto columns = row->columns();
 
-#ifdef DEBUG_SQLITE_COMMANDS
-    fprintf(stderr, "command: '%s'\n", command.c_str());
-#endif
+    auto stmt = prepare_insert(table, columns);
+    if (stmt == NULL)
+        return error_result();
 
-    /* SQLite fills out an argument pointer, so we need one
-     * created. */
-    auto out = std::make_shared<result>();
+    for (size_t i = 0; i < columns.size(); ++i)
+        stmt->bind(i + 1, row->get(columns[i]));
+
+    return execute(stmt);
+}
+
+std::vector<error_code>
+connection::insert_many(const table::ptr& table,
+                        const std::vector<row::ptr>& rows)
+{
+    std::vector<error_code> out;
+    out.reserve(rows.size());
+
+    /* Without a transaction SQLite would sync every single row to
+     * disk. */
+    psqlite::immediate_transaction::ptr batch = NULL;
+    if (_tr.lock() == NULL) {
+        batch = immediate_transaction();
+        if (batch == NULL)
+            return std::vector<error_code>(rows.size(),
+                                           error_code::FAILED_BUSY);
+    }
+
+    std::vector<std::string> columns;
+    statement::ptr stmt = NULL;
+    for (const auto& row: rows) {
+        auto row_columns = row->columns();
+        if (stmt == NULL || row_columns != columns) {
+            columns = row_columns;
+            stmt = prepare_insert(table, columns);
+            if (stmt == NULL) {
+                out.push_back(to_error_code(sqlite3_errcode(_db),
+                                            sqlite3_errmsg(_db)));
+                continue;
+            }
+        }
+
+        for (size_t i = 0; i < columns.size(); ++i)
+            stmt->bind(i + 1, row->get(columns[i]));
+
+        out.push_back(run(stmt));
+    }
 
-    /* At this point the SQL query can actually be run. */
-    {
-        struct sqlite3_exec_args args;
-        char *error_string = NULL;
-        args.result_ptr = out;
-        int error = sqlite3_exec(_db,
-                                 command.c_str(),
-                                 &sqlite3_exec_func,
-                                 &args,
-                                 &error_string);
-        if (error_string == NULL)
-            error_string = (char *)"";
-        out->set_error(error, error_string);
-    }
-
-    /* Finally we can clean up those allocated strings and return! */
     return out;
 }
 
@@ -320,84 +287,105 @@ result::ptr connection::replace(const table::ptr& table,
                                                const char *format,
                                                va_list args)
 {
-    /* It turns out that SQLite provides a mechanism for eliminating
-     * SQL injection attacks, but it conflicts with GCC's printf-like
-     * format string checker.  Thus I work around the problem by
-     * simply converting everything to injection-proof right here. */
-    char *nformat = new char[strlen(format) + 1];
-    strcpy(nformat, format);
-    for (size_t i = 0; i < strlen(nformat); ++i)
-        if (strncmp(nformat + i, "%s",  2) == 0)
-            nformat[i+1] = 'q';
-
-    /* Here we format the string to avoid injection attacks. */
-    va_list sargs; va_copy(sargs, args);
-    char test_args[2];
-    size_t query_length = vsnprintf(test_args, 2, format, sargs) + 1;
-    char *query = new char[query_length];
-    sqlite3_vsnprintf(query_length, query, nformat, args);
-
-    /* That's not the whole SQL command, we also need the "SELECT (...)
-     * FROM ..." part.  */
-    size_t column_length = 3;
-    for (const auto& column: row->columns()) {
-        column_length += strlen(column.c_str());
-        column_length += 2;
-        column_length += strlen(row->value(column).c_str());
-        column_length += 3;
-    }
-    char *column_spec = new char[column_length];
-    column_spec[0] = '\0';
-    for (const auto& column: row->columns()) {
-        strcat(column_spec, column.c_str());
-        strcat(column_spec, "='");
-        strcat(column_spec, row->value(column).c_str() );
-        strcat(column_spec, "', ");
-    }
-    column_spec[strlen(column_spec)-2] = '\0';
-
-    /* Now we can assemble the final SQL query string. */
-    size_t command_length =
-        strlen("UPDATE ")
-        + strlen(table->name().c_str())
-        + strlen(" SET ")
-        + strlen(column_spec)
-        + strlen(" WHERE ")
-        + strlen(query)
-        + 2;
-    char *command = new char[command_length];
-    sprintf(command, "UPDATE %s SET %s WHERE %s;",
-            table->name().c_str(),
-            column_spec,
-            query);
-#ifdef DEBUG_SQLITE_COMMANDS
-    fprintf(stderr, "command: '%s'\n", command);
-#endif
+    auto columns = row->columns();
 
-    /* SQLite fills out an argument pointer, so we need one
-     * created. */
-    auto out = std::make_shared<result>();
+    std::string command = "UPDATE " + table->name() + " SET ";
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (i != 0)
+            command += ", ";
+        command += columns[i] + "=?" + std::to_string(i + 1);
+    }
+    command += " WHERE ";
+
+    auto stmt = prepare_where(command, columns.size() + 1, format, args);
+    if (stmt == NULL)
+        return error_result();
+
+    for (size_t i = 0; i < columns.size(); ++i)
+        stmt->bind(i + 1, row->get(columns[i]));
+
+    return execute(stmt);
+}
+
+std::vector<error_code>
+connection::replace_many(const table::ptr& table,
+                         const std::vector<row::ptr>& rows,
+                         const std::vector<std::string>& keys)
+{
+    /* Without any keys every row would match, which is never what
+     * anyone wants. */
+    if (keys.size() == 0)
+        return std::vector<error_code>(rows.size(),
+                                       error_code::FAILED_MISSING_KEY);
+
+    std::vector<error_code> out;
+    out.reserve(rows.size());
+
+    psqlite::immediate_transaction::ptr batch = NULL;
+    if (_tr.lock() == NULL) {
+        batch = immediate_transaction();
+        if (batch == NULL)
+            return std::vector<error_code>(rows.size(),
+                                           error_code::FAILED_BUSY);
+    }
+
+    std::vector<std::string> columns;
+    statement::ptr stmt = NULL;
+    for (const auto& row: rows) {
+        bool has_keys = true;
+        for (const auto& key: keys)
+            if (row->has(key) == false)
+                has_keys = false;
+        if (has_keys == false) {
+            out.push_back(error_code::FAILED_MISSING_KEY);
+            continue;
+        }
+
+        std::vector<std::string> row_columns;
+        for (const auto& column: row->columns())
+            if (std::find(keys.begin(), keys.end(), column) == keys.end())
+                row_columns.push_back(column);
+
+        /* There's nothing to do for a row that only has keys. */
+        if (row_columns.size() == 0) {
+            out.push_back(error_code::SUCCESS);
+            continue;
+        }
+
+        if (stmt == NULL || row_columns != columns) {
+            columns = row_columns;
+
+            std::string command = "UPDATE " + table->name() + " SET ";
+            for (size_t i = 0; i < columns.size(); ++i) {
+                if (i != 0)
+                    command += ", ";
+                command += columns[i] + "=?" + std::to_string(i + 1);
+            }
+            command += " WHERE ";
+            for (size_t i = 0; i < keys.size(); ++i) {
+                if (i != 0)
+                    command += " AND ";
+                command += keys[i] + "=?"
+                    + std::to_string(columns.size() + i + 1);
+            }
+            command += ";";
+
+            stmt = prepare(command, true);
+            if (stmt == NULL) {
+                out.push_back(to_error_code(sqlite3_errcode(_db),
+                                            sqlite3_errmsg(_db)));
+                continue;
+            }
+        }
+
+        for (size_t i = 0; i < columns.size(); ++i)
+            stmt->bind(i + 1, row->get(columns[i]));
+        for (size_t i = 0; i < keys.size(); ++i)
+            stmt->bind(columns.size() + i + 1, row->get(keys[i]));
+
+        out.push_back(run(stmt));
+    }
 
-    /* At this point the SQL query can actually be run. */
-    {
-        struct sqlite3_exec_args args;
-        char *error_string = NULL;
-        args.result_ptr = out;
-        int error = sqlite3_exec(_db,
-                                 command,
-                                 &sqlite3_exec_func,
-                                 &args,
-                                 &error_string);
-        if (error_string == NULL)
-            error_string = (char *)"";
-        out->set_error(error, error_string);
-    }
-
-    /* Finally we can clean up those allocated strings and return! */
-    delete[] nformat;
-    delete[] query;
-    delete[] column_spec;
-    delete[] command;
     return out;
 }
 
@@ -415,62 +403,13 @@ result::ptr connection::remove(const table::ptr& table,
                                               const char *format,
                                               va_list args)
 {
-    /* It turns out that SQLite provides a mechanism for eliminating
-     * SQL injection attacks, but it conflicts with GCC's printf-like
-     * format string checker.  Thus I work around the problem by
-     * simply converting everything to injection-proof right here. */
-    char *nformat = new char[strlen(format) + 1];
-    strcpy(nformat, format);
-    for (size_t i = 0; i < strlen(nformat); ++i)
-        if (strncmp(nformat + i, "%s",  2) == 0)
-            nformat[i+1] = 'q';
-
-    /* Here we format the string to avoid injection attacks. */
-    va_list sargs; va_copy(sargs, args);
-    char test_args[2];
-    size_t query_length = vsnprintf(test_args, 2, format, sargs) + 1;
-    char *query = new char[query_length];
-    sqlite3_vsnprintf(query_length, query, nformat, args);
-
-    /* Now we can assemble the final SQL query string. */
-    size_t command_length =
-        strlen("DELETE FROM ")
-        + strlen(table->name().c_str())
-        + strlen(" WHERE ")
-        + strlen(query)
-        + 2;
-    char *command = new char[command_length];
-    sprintf(command, "DELETE FROM %s WHERE %s;",
-            table->name().c_str(),
-            query);
-#ifdef DEBUG_SQLITE_COMMANDS
-    fprintf(stderr, "command: '%s'\n", command);
-#endif
+    std::string command = "DELETE FROM " + table->name() + " WHERE ";
 
-    /* SQLite fills out an argument pointer, so we need one
-     * created. */
-    auto out = std::make_shared<result>();
+    auto stmt = prepare_where(command, 1, format, args);
+    if (stmt == NULL)
+        return error_result();
 
-    /* At this point the SQL query can actually be run. */
-    {
-        struct sqlite3_exec_args args;
-        char *error_string = NULL;
-        args.result_ptr = out;
-        int error = sqlite3_exec(_db,
-                                 command,
-                                 &sqlite3_exec_func,
-                                 &args,
-                                 &error_string);
-        if (error_string == NULL)
-            error_string = (char *)"";
-        out->set_error(error, error_string);
-    }
-
-    /* Finally we can clean up those allocated strings and return! */
-    delete[] nformat;
-    delete[] query;
-    delete[] command;
-    return out;
+    return execute(stmt);
 }
 
 result::ptr connection::clear(const table::ptr& table,
@@ -489,85 +428,19 @@ result::ptr connection::clear(const table::ptr& table,
                                              const char *format,
                                              va_list args)
 {
-    /* It turns out that SQLite provides a mechanism for eliminating
-     * SQL injection attacks, but it conflicts with GCC's printf-like
-     * format string checker.  Thus I work around the problem by
-     * simply converting everything to injection-proof right here. */
-    char *nformat = new char[strlen(format) + 1];
-    strcpy(nformat, format);
-    for (size_t i = 0; i < strlen(nformat); ++i)
-        if (strncmp(nformat + i, "%s",  2) == 0)
-            nformat[i+1] = 'q';
-
-    /* Here we format the string to avoid injection attacks. */
-    va_list sargs; va_copy(sargs, args);
-    char test_args[2];
-    size_t query_length = vsnprintf(test_args, 2, format, sargs) + 1;
-    char *query = new char[query_length];
-    sqlite3_vsnprintf(query_length, query, nformat, args);
-
-    /* That's not the whole SQL command, we also need the "SELECT (...)
-     * FROM ..." part.  */
-    size_t column_length = 3;
-    for (const auto& column: cols) {
-        column_length += strlen(column.c_str());
-        column_length += 3;
-        column_length += strlen("NULL");
-        column_length += 1;
-    }
-    char *column_spec = new char[column_length];
-    column_spec[0] = '\0';
-    for (const auto& column: cols) {
-        strcat(column_spec, column.c_str());
-        strcat(column_spec, "=");
-        strcat(column_spec, "NULL");
-        strcat(column_spec, ", ");
-    }
-    column_spec[strlen(column_spec)-2] = '\0';
-
-    /* Now we can assemble the final SQL query string. */
-    size_t command_length =
-        strlen("UPDATE ")
-        + strlen(table->name().c_str())
-        + strlen(" SET ")
-        + strlen(column_spec)
-        + strlen(" WHERE ")
-        + strlen(query)
-        + 2;
-    char *command = new char[command_length];
-    sprintf(command, "UPDATE %s SET %s WHERE %s;",
-            table->name().c_str(),
-            column_spec,
-            query);
-#ifdef DEBUG_SQLITE_COMMANDS
-    fprintf(stderr, "command: '%s'\n", command);
-#endif
+    std::string command = "UPDATE " + table->name() + " SET ";
+    for (size_t i = 0; i < cols.size(); ++i) {
+        if (i != 0)
+            command += ", ";
+        command += cols[i] + "=NULL";
+    }
+    command += " WHERE ";
 
-    /* SQLite fills out an argument pointer, so we need one
-     * created. */
-    auto out = std::make_shared<result>();
+    auto stmt = prepare_where(command, 1, format, args);
+    if (stmt == NULL)
+        return error_result();
 
-    /* At this point the SQL query can actually be run. */
-    {
-        struct sqlite3_exec_args args;
-        char *error_string = NULL;
-        args.result_ptr = out;
-        int error = sqlite3_exec(_db,
-                                 command,
-                                 &sqlite3_exec_func,
-                                 &args,
-                                 &error_string);
-        if (error_string == NULL)
-            error_string = (char *)"";
-        out->set_error(error, error_string);
-    }
-
-    /* Finally we can clean up those allocated strings and return! */
-    delete[] nformat;
-    delete[] query;
-    delete[] column_spec;
-    delete[] command;
-    return out;
+    return execute(stmt);
 }
 
 exclusive_transaction::ptr
@@ -586,31 +459,20 @@ connection::exclusive_transaction(void)
         return cast;
     }
 
-#ifdef DEBUG_SQLITE_COMMANDS
-    fprintf(stderr, "command: '%s'\n", "BEGIN EXCLUSIVE TRANSACTION;");
-#endif
-
     /* At this point the SQL query can actually be run. */
     {
-        auto out = std::make_shared<result>();
-        struct sqlite3_exec_args args;
-        char *error_string = NULL;
-        args.result_ptr = out;
-        int error = sqlite3_exec(_db,
-                                 "BEGIN EXCLUSIVE TRANSACTION;",
-                                 &sqlite3_exec_func,
-                                 &args,
-                                 &error_string);
-        if (error_string == NULL)
-            error_string = (char *)"";
-        out->set_error(error, error_string);
-
+        auto out = execute("BEGIN EXCLUSIVE TRANSACTION;");
         switch (out->return_value()) {
         case error_code::SUCCESS:
             break;
 
+            /* Someone else has the database locked. */
+        case error_code::FAILED_BUSY:
+            return NULL;
+
             /* These error codes can't actually happen. */
         case error_code::FAILED_UNIQUE:
+        case error_code::FAILED_MISSING_KEY:
             fprintf(stderr, "Error opening transaction: '%s'\n",
                     out->return_string().c_str());
             abort();
@@ -620,6 +482,7 @@ connection::exclusive_transaction(void)
 
     auto ntr = std::make_shared<psqlite::exclusive_transaction>(this);
     _tr = ntr;
+    transaction_started();
     return ntr;
 }
 
@@ -639,31 +502,20 @@ connection::immediate_transaction(void)
         return cast;
     }
 
-#ifdef DEBUG_SQLITE_COMMANDS
-    fprintf(stderr, "command: '%s'\n", "BEGIN IMMEDIATE TRANSACTION;");
-#endif
-
     /* At this point the SQL query can actually be run. */
     {
-        auto out = std::make_shared<result>();
-        struct sqlite3_exec_args args;
-        char *error_string = NULL;
-        args.result_ptr = out;
-        int error = sqlite3_exec(_db,
-                                 "BEGIN IMMEDIATE TRANSACTION;",
-                                 &sqlite3_exec_func,
-                                 &args,
-                                 &error_string);
-        if (error_string == NULL)
-            error_string = (char *)"";
-        out->set_error(error, error_string);
-
+        auto out = execute("BEGIN IMMEDIATE TRANSACTION;");
         switch (out->return_value()) {
         case error_code::SUCCESS:
             break;
 
+            /* Someone else has the database locked. */
+        case error_code::FAILED_BUSY:
+            return NULL;
+
             /* These error codes can't actually happen. */
         case error_code::FAILED_UNIQUE:
+        case error_code::FAILED_MISSING_KEY:
             fprintf(stderr, "Error opening transaction: '%s'\n",
                     out->return_string().c_str());
             abort();
@@ -673,6 +525,7 @@ connection::immediate_transaction(void)
 
     auto ntr = std::make_shared<psqlite::immediate_transaction>(this);
     _tr = ntr;
+    transaction_started();
     return ntr;
 }
 
@@ -692,31 +545,20 @@ connection::deferred_transaction(void)
         return cast;
     }
 
-#ifdef DEBUG_SQLITE_COMMANDS
-    fprintf(stderr, "command: '%s'\n", "BEGIN DEFERRED TRANSACTION;");
-#endif
-
     /* At this point the SQL query can actually be run. */
     {
-        auto out = std::make_shared<result>();
-        struct sqlite3_exec_args args;
-        char *error_string = NULL;
-        args.result_ptr = out;
-        int error = sqlite3_exec(_db,
-                                 "BEGIN DEFERRED TRANSACTION;",
-                                 &sqlite3_exec_func,
-                                 &args,
-                                 &error_string);
-        if (error_string == NULL)
-            error_string = (char *)"";
-        out->set_error(error, error_string);
-
+        auto out = execute("BEGIN DEFERRED TRANSACTION;");
         switch (out->return_value()) {
         case error_code::SUCCESS:
             break;
 
+            /* Someone else has the database locked. */
+        case error_code::FAILED_BUSY:
+            return NULL;
+
             /* These error codes can't actually happen. */
         case error_code::FAILED_UNIQUE:
+        case error_code::FAILED_MISSING_KEY:
             fprintf(stderr, "Error opening transaction: '%s'\n",
                     out->return_string().c_str());
             abort();
@@ -726,85 +568,783 @@ connection::deferred_transaction(void)
 
     auto ntr = std::make_shared<psqlite::deferred_transaction>(this);
     _tr = ntr;
+    transaction_started();
     return ntr;
 }
 
 result::ptr connection::create(const table::ptr& table)
 {
-    std::ostringstream ss;
-
-    ss << "CREATE TABLE IF NOT EXISTS " << table->name() << " (";
-    {
-        std::vector<std::string> col_names;
-        for (const auto& col: table->columns()) {
-            col_names.push_back(col->name());
-            col_names.push_back(", ");
+    /* A composite primary key can't be declared on any one of its
+     * columns, so it goes at the end instead. */
+    std::vector<std::string> primary_key;
+    for (const auto& col: table->columns())
+        if (col->primary_key() == true)
+            primary_key.push_back(col->name());
+
+    std::string command = "CREATE TABLE IF NOT EXISTS " + table->name() + " (";
+    for (size_t i = 0; i < table->columns().size(); ++i) {
+        const auto& col = table->columns()[i];
+        if (i != 0)
+            command += ", ";
+        command += col->name();
+        if (col->type().empty() == false)
+            command += " " + col->type();
+        if (col->primary_key() == true && primary_key.size() == 1)
+            command += " PRIMARY KEY";
+        if (col->unique() == true)
+            command += " UNIQUE";
+        if (col->not_null() == true)
+            command += " NOT NULL";
+    }
+    if (primary_key.size() > 1) {
+        command += ", PRIMARY KEY (";
+        for (size_t i = 0; i < primary_key.size(); ++i) {
+            if (i != 0)
+                command += ", ";
+            command += primary_key[i];
+        }
+        command += ")";
+    }
+    command += ");";
+
+    std::vector<std::string> commands = {command};
+    for (const auto& index: table->indexes()) {
+        command = "CREATE ";
+        if (index->unique() == true)
+            command += "UNIQUE ";
+        command += "INDEX IF NOT EXISTS " + index->name();
+        command += " ON " + table->name() + " (";
+        for (size_t i = 0; i < index->columns().size(); ++i) {
+            if (i != 0)
+                command += ", ";
+            command += index->columns()[i];
         }
-        col_names.erase(col_names.begin() + (col_names.size() - 1));
-        copy(col_names.begin(),
-             col_names.end(),
-             std::ostream_iterator<std::string>(ss, ""));
+        command += ")";
+        if (index->where().empty() == false)
+            command += " WHERE " + index->where();
+        command += ";";
+        commands.push_back(command);
     }
-    ss << ");";
 
-#ifdef DEBUG_SQLITE_COMMANDS
-    fprintf(stderr, "command: '%s'\n", ss.str().c_str());
-#endif
+    _results.invalidate(table->name());
 
-    auto out = std::make_shared<result>();
-    struct sqlite3_exec_args args;
-    char *error_string = NULL;
-    args.result_ptr = out;
-    int error = sqlite3_exec(_db,
-                             ss.str().c_str(),
-                             &sqlite3_exec_func,
-                             &args,
-                             &error_string);
-    if (error_string == NULL)
-        error_string = (char *)"";
-    out->set_error(error, error_string);
+    /* Tables only get created once, so there's no point in keeping
+     * the statements around. */
+    result::ptr out;
+    for (const auto& c: commands) {
+        auto stmt = prepare(c, false);
+        if (stmt == NULL)
+            return error_result();
+
+        out = execute(stmt);
+        if (out->return_value() != error_code::SUCCESS)
+            return out;
+    }
 
     return out;
 }
 
+void connection::set_busy_timeout(int ms)
+{
+    _busy_handler = NULL;
+    _busy_timeout = ms;
+    update_busy_handler();
+}
+
+void connection::set_busy_handler(const std::function<bool(int)>& handler)
+{
+    _busy_handler = handler;
+    update_busy_handler();
+}
+
+void connection::set_instrument(const instrument::ptr& instrument)
+{
+    _instrument = instrument;
+    _tr_timed = false;
+    update_busy_handler();
+}
+
+void connection::enable_result_cache(const table::ptr& table)
+{
+    /* The hooks are only installed while they're needed, as they
+     * get called for every single row that's written. */
+    if (_results.any_enabled() == false) {
+        sqlite3_update_hook(_db, &update_callback, this);
+        sqlite3_rollback_hook(_db, &rollback_callback, this);
+        _data_version = -1;
+    }
+
+    _results.enable(table->name());
+}
+
+void connection::disable_result_cache(const table::ptr& table)
+{
+    _results.disable(table->name());
+
+    if (_results.any_enabled() == false) {
+        sqlite3_update_hook(_db, NULL, NULL);
+        sqlite3_rollback_hook(_db, NULL, NULL);
+        _results.clear();
+    }
+}
+
+result::ptr connection::savepoint(const std::string& name)
+{
+    return execute("SAVEPOINT " + name + ";");
+}
+
+result::ptr connection::rollback_to_savepoint(const std::string& name)
+{
+    /* SQLite's rollback hook doesn't fire for savepoints, but the
+     * result cache could still have seen the rows that are about to
+     * go away. */
+    _results.clear();
+    return execute("ROLLBACK TO SAVEPOINT " + name + ";");
+}
+
+result::ptr connection::release_savepoint(const std::string& name)
+{
+    return execute("RELEASE SAVEPOINT " + name + ";");
+}
+
+result::ptr connection::enable_wal(void)
+{
+    return execute("PRAGMA journal_mode=WAL;");
+}
+
 result::ptr connection::commit_transaction(void)
+{
+    auto out = execute("END TRANSACTION;");
+
+    if (_tr_timed == true && _instrument != NULL) {
+        auto held = std::chrono::steady_clock::now() - _tr_start;
+        _instrument->transaction_finished(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(held).count());
+    }
+    _tr_timed = false;
+
+    return out;
+}
+
+statement::ptr connection::prepare(const std::string& sql, bool cacheable)
 {
 #ifdef DEBUG_SQLITE_COMMANDS
-    fprintf(stderr, "command: '%s'\n", "END TRANSACTION;");
+    fprintf(stderr, "command: '%s'\n", sql.c_str());
 #endif
 
-    auto out = std::make_shared<result>();
-    struct sqlite3_exec_args args;
-    char *error_string = NULL;
-    args.result_ptr = out;
-    int error = sqlite3_exec(_db,
-                             "END TRANSACTION;",
-                             &sqlite3_exec_func,
-                             &args,
-                             &error_string);
-    if (error_string == NULL)
-        error_string = (char *)"";
-    out->set_error(error, error_string);
+    if (cacheable == true) {
+        auto cached = _stmts.take(sql);
+        if (cached != NULL) {
+            /* The statement may have been cached before anyone
+             * asked for plans to be checked. */
+            if (_plan_check != plan_check::NONE)
+                check_plan(cached);
+            return cached;
+        }
+    }
+
+    sqlite3_stmt *stmt = NULL;
+    int error = sqlite3_prepare_v2(_db, sql.c_str(), sql.size(), &stmt, NULL);
+    if (error != SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        return NULL;
+    }
+
+    auto out = std::make_shared<statement>(stmt, sql, cacheable);
+
+    /* Statements that aren't cacheable get checked once they know
+     * their shape, see prepare_where(). */
+    if (_plan_check != plan_check::NONE && cacheable == true)
+        check_plan(out);
 
     return out;
 }
 
-int sqlite3_exec_func(void *args_uncast,
-                      int count,
-                      char **data,
-                      char **names)
+void connection::check_plan(const statement::ptr& stmt)
 {
-    std::map<std::string, std::string> name2datum;
-    for (int i = 0; i < count; ++i) {
-        if (data[i] != NULL) {
-            std::string name = names[i];
-            std::string datum = data[i];
-            name2datum[name] = datum;
+    const auto& shape = stmt->shape();
+    const auto& sql = stmt->sql();
+
+    /* Only statements that filter rows can be helped by an index,
+     * and the ones that match every row are supposed to scan. */
+    bool filters = (shape.compare(0, 7, "SELECT ") == 0)
+        || (shape.compare(0, 7, "UPDATE ") == 0)
+        || (shape.compare(0, 7, "DELETE ") == 0);
+    if (filters == false)
+        return;
+
+    std::string all = " WHERE " ALL_ROWS ";";
+    if (shape.size() >= all.size()
+        && shape.compare(shape.size() - all.size(), all.size(), all) == 0)
+        return;
+
+    /* Every run of the same shape has the same plan, so each one is
+     * only checked once. */
+    if (_planned.insert(shape).second == false)
+        return;
+
+    /* This goes straight to SQLite, as prepare() would end up back
+     * here. */
+    auto explain = "EXPLAIN QUERY PLAN " + sql;
+    sqlite3_stmt *explained = NULL;
+    int error = sqlite3_prepare_v2(_db, explain.c_str(), explain.size(),
+                                   &explained, NULL);
+    if (error != SQLITE_OK) {
+        sqlite3_finalize(explained);
+        return;
+    }
+
+    /* The fourth column describes each step of the plan, and a full
+     * scan shows up as "SCAN <table>" (or "SCAN TABLE <table>" on
+     * older versions of SQLite). */
+    bool scans = false;
+    while (sqlite3_step(explained) == SQLITE_ROW) {
+        auto detail = (const char *)sqlite3_column_text(explained, 3);
+        if (detail == NULL || strncmp(detail, "SCAN ", 5) != 0)
+            continue;
+        if (strcmp(detail, "SCAN CONSTANT ROW") == 0)
+            continue;
+
+        fprintf(stderr, "Full table scan: '%s'\n", shape.c_str());
+        fprintf(stderr, "  plan: %s\n", detail);
+        scans = true;
+    }
+    sqlite3_finalize(explained);
+
+    if (scans == true && _plan_check == plan_check::ABORT)
+        abort();
+}
+
+statement::ptr connection::prepare_where(const std::string& prefix,
+                                         int first,
+                                         const char *format,
+                                         va_list args)
+{
+    /* The first pass just figures out what the SQL looks like, which
+     * only depends on the format string and is therefore the same
+     * every time a given query is run. */
+    std::string command = prefix;
+    int index = first;
+    bool bindable = walk_where(
+        format,
+        [&](char c) { command += c; },
+        [&](const char *, size_t, where_arg, bool)
+        {
+            command += "?" + std::to_string(index++);
+        });
+
+    if (bindable == false) {
+        /* It turns out that SQLite provides a mechanism for
+         * eliminating SQL injection attacks, but it conflicts with
+         * GCC's printf-like format string checker.  Thus I work
+         * around the problem by simply converting everything to
+         * injection-proof right here. */
+        std::string nformat = format;
+        for (size_t i = 0; i + 1 < nformat.size(); ++i)
+            if (nformat[i] == '%' && nformat[i+1] == 's')
+                nformat[i+1] = 'q';
+
+        char *query = sqlite3_vmprintf(nformat.c_str(), args);
+        auto stmt = prepare(prefix + query + ";", false);
+        sqlite3_free(query);
+
+        /* The format string stands in for the query's shape, so the
+         * arguments don't end up in any statistics. */
+        if (stmt != NULL) {
+            stmt->set_shape(prefix + format + ";");
+            if (_plan_check != plan_check::NONE)
+                check_plan(stmt);
         }
+        return stmt;
     }
 
-    struct sqlite3_exec_args *args = (struct sqlite3_exec_args *)args_uncast;
-    args->result_ptr->add_map(name2datum);
+    command += ";";
+    auto stmt = prepare(command, true);
+    if (stmt == NULL)
+        return NULL;
+
+    /* The second pass actually binds the arguments, which have to be
+     * pulled out of the va_list in order. */
+    va_list bargs; va_copy(bargs, args);
+    index = first;
+    walk_where(
+        format,
+        [](char) {},
+        [&](const char *spec, size_t length, where_arg arg, bool quoted)
+        {
+            bind_arg(stmt, index++, spec, length, arg, quoted, &bargs);
+        });
+    va_end(bargs);
+
+    return stmt;
+}
+
+statement::ptr connection::prepare_select(const table::ptr& table,
+                                          const std::vector<column::ptr>& c,
+                                          const char *format,
+                                          va_list args)
+{
+    std::string command = "SELECT ";
+    for (size_t i = 0; i < c.size(); ++i) {
+        if (i != 0)
+            command += ", ";
+        command += c[i]->name();
+    }
+    command += " FROM " + table->name() + " WHERE ";
+
+    return prepare_where(command, 1, format, args);
+}
+
+statement::ptr connection::prepare_insert(const table::ptr& table,
+                                          const std::vector<std::string>& cols)
+{
+    std::string command = "INSERT INTO " + table->name() + " (";
+    for (size_t i = 0; i < cols.size(); ++i) {
+        if (i != 0)
+            command += ", ";
+        command += cols[i];
+    }
+    command += ") VALUES (";
+    for (size_t i = 0; i < cols.size(); ++i) {
+        if (i != 0)
+            command += ", ";
+        command += "?" + std::to_string(i + 1);
+    }
+    command += ");";
+
+    return prepare(command, true);
+}
+
+error_code connection::run(const statement::ptr& stmt)
+{
+    std::chrono::steady_clock::time_point start;
+    if (_instrument != NULL)
+        start = start_profile(stmt);
+
+    int error;
+    while ((error = stmt->step()) == SQLITE_ROW)
+        ;
+
+    if (error == SQLITE_DONE)
+        error = SQLITE_OK;
+
+    /* This has to happen before the reset, as that would clear the
+     * error message. */
+    auto out = to_error_code(error, sqlite3_errmsg(_db));
+    if (_instrument != NULL)
+        profile(stmt, 0, start);
+    release(stmt);
+    return out;
+}
+
+result::ptr connection::execute(const statement::ptr& stmt)
+{
+    return execute(std::make_shared<cursor>(this, stmt));
+}
+
+result::ptr connection::execute(const cursor::ptr& cur)
+{
+    auto out = std::make_shared<result>();
+    for (const auto& row: cur)
+        out->add_row(*row);
+    out->set_error((int)cur->return_value(), cur->return_string());
+    return out;
+}
+
+result::ptr connection::execute_cached(const table::ptr& table,
+                                       const statement::ptr& stmt)
+{
+    if (_results.enabled(table->name()) == false)
+        return execute(stmt);
+
+    /* Statements that had their arguments escaped directly into
+     * the SQL are already unique, everything else needs to have its
+     * parameters filled in to tell the different runs apart. */
+    auto key = stmt->cacheable() ? stmt->bound_key() : stmt->sql();
+    if (key.empty())
+        return execute(stmt);
+
+    check_data_version();
+    auto cached = _results.find(key);
+    if (cached != NULL) {
+        release(stmt);
+        return cached;
+    }
+
+    auto out = execute(stmt);
+    if (out->return_value() == error_code::SUCCESS) {
+        /* Rows are usually built lazily, but cached results can end
+         * up being read from more than one thread. */
+        out->rows();
+        _results.insert(key, table->name(), out);
+    }
+    return out;
+}
+
+result::ptr connection::execute(const std::string& sql)
+{
+    auto stmt = prepare(sql, true);
+    if (stmt == NULL)
+        return error_result();
+
+    return execute(stmt);
+}
+
+void connection::release(const statement::ptr& stmt)
+{
+    stmt->reset();
+    if (stmt->cacheable() == true)
+        _stmts.give(stmt);
+}
+
+std::chrono::steady_clock::time_point
+connection::start_profile(const statement::ptr& stmt)
+{
+    /* The statement's counters may have been accumulating while
+     * nobody was looking, so they're cleared before it starts. */
+    auto handle = stmt->handle();
+    sqlite3_stmt_status(handle, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+    sqlite3_stmt_status(handle, SQLITE_STMTSTATUS_SORT, 1);
+    sqlite3_stmt_status(handle, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+    sqlite3_stmt_status(handle, SQLITE_STMTSTATUS_VM_STEP, 1);
+    return std::chrono::steady_clock::now();
+}
+
+void connection::profile(const statement::ptr& stmt,
+                         uint64_t rows,
+                         std::chrono::steady_clock::time_point start)
+{
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    auto handle = stmt->handle();
+
+    /* Every counter is reset as it's read, so the next run of this
+     * statement starts from zero. */
+    statement_profile p;
+    p.nanoseconds =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    p.rows = rows;
+    p.fullscan_steps =
+        sqlite3_stmt_status(handle, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+    p.sorts = sqlite3_stmt_status(handle, SQLITE_STMTSTATUS_SORT, 1);
+    p.autoindexes =
+        sqlite3_stmt_status(handle, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+    p.vm_steps = sqlite3_stmt_status(handle, SQLITE_STMTSTATUS_VM_STEP, 1);
+
+    _instrument->statement_finished(stmt->shape(), p);
+}
+
+result::ptr connection::error_result(void)
+{
+    auto out = std::make_shared<result>();
+    out->set_error(sqlite3_errcode(_db), sqlite3_errmsg(_db));
+    return out;
+}
+
+void connection::transaction_started(void)
+{
+    _tr_timed = (_instrument != NULL);
+    if (_tr_timed == true)
+        _tr_start = std::chrono::steady_clock::now();
+}
+
+void connection::update_busy_handler(void)
+{
+    /* SQLite's built-in timeout is used whenever possible, but it
+     * doesn't provide any way to count retries. */
+    if (_busy_handler == NULL && _instrument == NULL)
+        sqlite3_busy_timeout(_db, _busy_timeout);
+    else
+        sqlite3_busy_handler(_db, &busy_callback, this);
+}
+
+void connection::check_data_version(void)
+{
+    auto stmt = prepare("PRAGMA data_version;", true);
+    if (stmt == NULL)
+        return;
+
+    int64_t version = -1;
+    if (stmt->step() == SQLITE_ROW)
+        version = sqlite3_column_int64(stmt->handle(), 0);
+    release(stmt);
+
+    if (version != _data_version) {
+        _results.clear();
+        _data_version = version;
+    }
+}
+
+void connection::update_callback(void *conn_uncast,
+                                 int op __attribute__((unused)),
+                                 const char *db __attribute__((unused)),
+                                 const char *table,
+                                 sqlite3_int64 rowid __attribute__((unused)))
+{
+    auto conn = (connection *)conn_uncast;
+    conn->_results.invalidate(table);
+}
+
+void connection::rollback_callback(void *conn_uncast)
+{
+    /* Anything that was cached since the transaction started might
+     * have seen rows that no longer exist. */
+    auto conn = (connection *)conn_uncast;
+    conn->_results.clear();
+}
+
+int connection::busy_callback(void *conn_uncast, int count)
+{
+    auto conn = (connection *)conn_uncast;
+
+    if (conn->_instrument != NULL)
+        conn->_instrument->busy_retry(count);
+
+    if (conn->_busy_handler != NULL)
+        return conn->_busy_handler(count) ? 1 : 0;
+
+    /* This mirrors SQLite's own timeout, which backs off until it's
+     * sleeping for 100ms at a time. */
+    static const int delays[] = { 1, 2, 5, 10, 15, 20, 25, 25, 25, 50, 50, 100 };
+    static const int ndelays = sizeof(delays) / sizeof(delays[0]);
+    int slept = 0;
+    for (int i = 0; i < count && i < ndelays; ++i)
+        slept += delays[i];
+    if (count >= ndelays)
+        slept += (count - ndelays) * delays[ndelays - 1];
+
+    int delay = delays[(count < ndelays) ? count : (ndelays - 1)];
+    if (slept + delay > conn->_busy_timeout) {
+        delay = conn->_busy_timeout - slept;
+        if (delay <= 0)
+            return 0;
+    }
+
+    sqlite3_sleep(delay);
+    return 1;
+}
+
+size_t parse_conversion(const char *p, where_arg *arg)
+{
+    size_t i = 1;
+
+    enum { NONE, L, LL, Z } length = NONE;
+    if (strncmp(p + i, "ll", 2) == 0) {
+        length = LL;
+        i += 2;
+    } else if (p[i] == 'l') {
+        length = L;
+        i++;
+    } else if (p[i] == 'z') {
+        length = Z;
+        i++;
+    }
+
+    switch (p[i]) {
+    case 'd':
+    case 'i':
+        switch (length) {
+        case NONE: *arg = where_arg::INT;   return i + 1;
+        case L:    *arg = where_arg::LONG;  return i + 1;
+        case LL:   *arg = where_arg::LLONG; return i + 1;
+        case Z:    return 0;
+        }
+        return 0;
+
+    case 'u':
+        switch (length) {
+        case NONE: *arg = where_arg::UINT;   return i + 1;
+        case L:    *arg = where_arg::ULONG;  return i + 1;
+        case LL:   *arg = where_arg::ULLONG; return i + 1;
+        case Z:    *arg = where_arg::SIZE;   return i + 1;
+        }
+        return 0;
+
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+        if (length != NONE && length != L)
+            return 0;
+        *arg = where_arg::DOUBLE;
+        return i + 1;
+
+    case 's':
+        if (length != NONE)
+            return 0;
+        *arg = where_arg::STRING;
+        return i + 1;
+
+    case 'c':
+        if (length != NONE)
+            return 0;
+        *arg = where_arg::CHAR;
+        return i + 1;
+    }
 
     return 0;
 }
+
+template<class T, class A>
+bool walk_where(const char *format, T text, A arg)
+{
+    enum { OUTSIDE, SINGLE, DOUBLE } quote = OUTSIDE;
+
+    for (size_t i = 0; format[i] != '\0'; ++i) {
+        if (format[i] == '%') {
+            if (format[i+1] == '%') {
+                text('%');
+                i++;
+                continue;
+            }
+
+            /* Conversions inside of a larger string literal (or an
+             * identifier) can't be parameters. */
+            if (quote != OUTSIDE)
+                return false;
+
+            where_arg type = where_arg::INT;
+            size_t length = parse_conversion(format + i, &type);
+            if (length == 0)
+                return false;
+
+            /* A bare "%s" expands to raw SQL, which could be
+             * anything at all. */
+            if (type == where_arg::STRING || type == where_arg::CHAR)
+                return false;
+
+            arg(format + i, length, type, false);
+            i += length - 1;
+            continue;
+        }
+
+        if (quote == OUTSIDE && format[i] == '\'') {
+            /* The common case is something like "name='%s'", where
+             * the whole literal can become a single parameter. */
+            where_arg type = where_arg::INT;
+            size_t length = 0;
+            if (format[i+1] == '%' && format[i+2] != '%')
+                length = parse_conversion(format + i + 1, &type);
+            if (length != 0 && format[i+1+length] == '\'') {
+                arg(format + i + 1, length, type, true);
+                i += length + 1;
+                continue;
+            }
+
+            quote = SINGLE;
+        } else if (quote == OUTSIDE && format[i] == '"') {
+            quote = DOUBLE;
+        } else if (quote == SINGLE && format[i] == '\'') {
+            /* SQL escapes quotes by doubling them up. */
+            if (format[i+1] == '\'') {
+                text(format[i++]);
+            } else {
+                quote = OUTSIDE;
+            }
+        } else if (quote == DOUBLE && format[i] == '"') {
+            quote = OUTSIDE;
+        }
+
+        text(format[i]);
+    }
+
+    return true;
+}
+
+void bind_arg(const statement::ptr& stmt,
+              int index,
+              const char *spec,
+              size_t length,
+              where_arg arg,
+              bool quoted,
+              va_list *args)
+{
+    /* Quoted arguments are SQL strings, so they're bound as text
+     * that's formatted exactly like printf() would have. */
+    if (quoted == true) {
+        std::string fspec(spec, length);
+        char buffer[64];
+        switch (arg) {
+        case where_arg::STRING:
+        {
+            /* This matches SQLite's behavior for "%q" and NULL. */
+            const char *str = va_arg(*args, const char *);
+            stmt->bind_text(index, (str == NULL) ? "(NULL)" : str);
+            return;
+        }
+        case where_arg::CHAR:
+            buffer[0] = va_arg(*args, int);
+            stmt->bind_text(index, buffer, 1);
+            return;
+        case where_arg::INT:
+            snprintf(buffer, 64, fspec.c_str(), va_arg(*args, int));
+            break;
+        case where_arg::UINT:
+            snprintf(buffer, 64, fspec.c_str(), va_arg(*args, unsigned));
+            break;
+        case where_arg::LONG:
+            snprintf(buffer, 64, fspec.c_str(), va_arg(*args, long));
+            break;
+        case where_arg::ULONG:
+            snprintf(buffer, 64, fspec.c_str(), va_arg(*args, unsigned long));
+            break;
+        case where_arg::LLONG:
+            snprintf(buffer, 64, fspec.c_str(), va_arg(*args, long long));
+            break;
+        case where_arg::ULLONG:
+            snprintf(buffer, 64, fspec.c_str(),
+                     va_arg(*args, unsigned long long));
+            break;
+        case where_arg::SIZE:
+            snprintf(buffer, 64, fspec.c_str(), va_arg(*args, size_t));
+            break;
+        case where_arg::DOUBLE:
+            snprintf(buffer, 64, fspec.c_str(), va_arg(*args, double));
+            break;
+        }
+        stmt->bind_text(index, buffer);
+        return;
+    }
+
+    /* Unquoted arguments are SQL numbers.  Unsigned values that
+     * don't fit in 64 bits would have been parsed as REAL by
+     * SQLite, so that's what they're bound as. */
+    unsigned long long u = 0;
+    switch (arg) {
+    case where_arg::INT:
+        stmt->bind_int64(index, va_arg(*args, int));
+        return;
+    case where_arg::LONG:
+        stmt->bind_int64(index, va_arg(*args, long));
+        return;
+    case where_arg::LLONG:
+        stmt->bind_int64(index, va_arg(*args, long long));
+        return;
+    case where_arg::UINT:
+        stmt->bind_int64(index, va_arg(*args, unsigned));
+        return;
+    case where_arg::ULONG:
+        u = va_arg(*args, unsigned long);
+        break;
+    case where_arg::ULLONG:
+        u = va_arg(*args, unsigned long long);
+        break;
+    case where_arg::SIZE:
+        u = va_arg(*args, size_t);
+        break;
+    case where_arg::DOUBLE:
+        stmt->bind_double(index, va_arg(*args, double));
+        return;
+    case where_arg::STRING:
+    case where_arg::CHAR:
+        fprintf(stderr, "Attempted to bind unquoted string\n");
+        abort();
+        return;
+    }
+
+    if (u > INT64_MAX)
+        stmt->bind_double(index, u);
+    else
+        stmt->bind_int64(index, u);
+}
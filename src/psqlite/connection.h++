@@ -8,18 +8,36 @@ namespace psqlite {
     class connection;
 }
 
+#include <chrono>
+#include <functional>
 #include <memory>
+#include "cursor.h++"
+#include "instrument.h++"
 #include "result.h++"
+#include "result_cache.h++"
+#include "statement_cache.h++"
 #include "table.h++"
 #include "transaction.h++"
 #include <sqlite3.h>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 namespace psqlite {
-    /* Holds a single database connection.  To avoid deadlock you
-     * almost certainly only want to open one of these per
-     * process! */
+    /* What to do when a query has to scan an entire table, see
+     * connection::set_plan_check(). */
+    enum class plan_check {
+        NONE,
+        REPORT,
+        ABORT,
+    };
+
+    /* Holds a single database connection.  Any number of these
+     * can be open on the same database (see connection_pool), but
+     * then they'll sometimes find it locked by each other: they
+     * wait according to set_busy_timeout() or set_busy_handler(),
+     * and once that gives up the operation fails with
+     * FAILED_BUSY. */
     class connection {
     public:
         typedef std::shared_ptr<connection> ptr;
@@ -35,10 +53,51 @@ namespace psqlite {
          * transaction. */
         std::weak_ptr<transaction> _tr;
 
+        /* Every command is run as a prepared statement, and the
+         * prepared statements are kept around here so that
+         * queries of the same shape only get parsed once. */
+        statement_cache _stmts;
+
+        /* Results of select() and count() on the tables that have
+         * opted in, along with the last "PRAGMA data_version" that
+         * was seen (which changes when another connection commits
+         * a write, and therefore anything could have changed). */
+        result_cache _results;
+        int64_t _data_version;
+
+        /* The handle this connection was most recently checked
+         * out of a pool as, which cursors hold onto so that the
+         * connection isn't given back while they're running. */
+        friend class connection_pool;
+        std::weak_ptr<connection> _self;
+
+        /* Whether new queries get their plans checked, and which
+         * queries have already been checked. */
+        enum plan_check _plan_check;
+        std::unordered_set<std::string> _planned;
+
+        /* An optional user-provided busy handler, see
+         * set_busy_handler(), and otherwise the busy timeout. */
+        std::function<bool(int)> _busy_handler;
+        int _busy_timeout;
+
+        /* Where performance data goes, which is NULL unless someone
+         * has asked for it (in which case nothing is measured). */
+        instrument::ptr _instrument;
+
+        /* When the current transaction was opened, which is only
+         * tracked when there's an instrument attached. */
+        std::chrono::steady_clock::time_point _tr_start;
+        bool _tr_timed;
+
     public:
         /* Opens a new connection to a SQLite database given the
-         * full path to the file that contains that database. */
+         * full path to the file that contains that database.  The
+         * flags are passed directly to sqlite3_open_v2(), and
+         * default to opening the database for reading and writing
+         * (creating it if necessary). */
         connection(const std::string& path);
+        connection(const std::string& path, int flags);
 
         ~connection(void);
 
@@ -67,6 +126,26 @@ namespace psqlite {
                            const char *format,
                            va_list args);
 
+        /* Exactly like select(), but returns a cursor that reads
+         * the matching rows in one at a time as it's stepped,
+         * rather than reading every row in before returning.  This
+         * is what select() itself is built on. */
+        cursor::ptr scan(const table::ptr& table);
+        cursor::ptr scan(const table::ptr& table,
+                         const char *format,
+                         ...) __attribute__(( format(printf, 3, 4) ));
+        cursor::ptr scan(const table::ptr& table,
+                         const char *format,
+                         va_list args);
+        cursor::ptr scan(const table::ptr& table,
+                         const std::vector<column::ptr>& c,
+                         const char *format,
+                         ...) __attribute__(( format(printf, 4, 5) ));
+        cursor::ptr scan(const table::ptr& table,
+                         const std::vector<column::ptr>& c,
+                         const char *format,
+                         va_list args);
+
         /* Exactly like select(), but just returns the count instead. */
         result::ptr count(const table::ptr& table);
         result::ptr count(const table::ptr& table,
@@ -92,6 +171,16 @@ namespace psqlite {
         result::ptr insert(const table::ptr& table,
                            const row::ptr& row);
 
+        /* Inserts a whole batch of rows, reusing a single prepared
+         * statement for every row that has the same columns.  If
+         * there's no transaction open then the batch is wrapped in
+         * an immediate transaction, so it's only synced to disk
+         * once.  A row that fails (for example, by violating a
+         * UNIQUE constraint) doesn't stop the rest of the batch,
+         * instead an error code is returned for every row. */
+        std::vector<error_code> insert_many(const table::ptr& table,
+                                            const std::vector<row::ptr>& rows);
+
         /* Runs a REPLACE query against the given table, returning
          * a list of results that come back from the SQLite server
          * (note that I expect this to be none...). */
@@ -104,6 +193,15 @@ namespace psqlite {
                             const char *format,
                             va_list args);
 
+        /* Like insert_many(), but updates existing rows instead.
+         * Each row is matched by the values of its "keys" columns,
+         * and every other non-NULL column is set from the row.  A
+         * row without a value for every key (or every row, if there
+         * aren't any keys) fails with FAILED_MISSING_KEY. */
+        std::vector<error_code> replace_many(const table::ptr& table,
+                                             const std::vector<row::ptr>& rows,
+                                             const std::vector<std::string>& keys);
+
         /* Removes any matching entries. */
         result::ptr remove(const table::ptr& table,
                            const char *format,
@@ -125,18 +223,187 @@ namespace psqlite {
 
         /* You can ask for two sorts of transactions on a
          * database: either a write-only lock or a read-write
-         * lock. */
+         * lock.  These return NULL if the database stayed locked
+         * by another connection for longer than the busy handler
+         * was willing to wait. */
         psqlite::exclusive_transaction::ptr exclusive_transaction(void);
         psqlite::immediate_transaction::ptr immediate_transaction(void);
         psqlite::deferred_transaction::ptr deferred_transaction(void);
 
-        /* Creates a new table */
+        /* Creates a new table, along with all of its indexes, if
+         * they don't already exist. */
         result::ptr create(const table::ptr& table);
 
+        /* Runs "EXPLAIN QUERY PLAN" the first time every query
+         * shape is seen, and either reports or aborts if SQLite would have
+         * to scan an entire table to run it (because there's no
+         * usable index).  Queries that are meant to read the whole
+         * table, like select() without a WHERE clause, are exempt.
+         * This is meant for testing, as it keeps track of every
+         * query shape ever run. */
+        void set_plan_check(enum plan_check check)
+            { _plan_check = check; }
+
+        /* Controls what happens when the database is locked by
+         * another connection: either retry for the given number of
+         * milliseconds (the default is 1000), or call the given
+         * handler with the number of times it's been called for
+         * this lock.  The handler returns TRUE to try again, and
+         * FALSE to give up (which fails with FAILED_BUSY). */
+        void set_busy_timeout(int ms);
+        void set_busy_handler(const std::function<bool(int)>& handler);
+
+        /* Savepoints mark a point inside a transaction that can
+         * be rolled back to, without giving up the rest of the
+         * transaction.  A savepoint has to be released either way,
+         * including after rolling back to it. */
+        result::ptr savepoint(const std::string& name);
+        result::ptr rollback_to_savepoint(const std::string& name);
+        result::ptr release_savepoint(const std::string& name);
+
+        /* Switches the database over to write-ahead logging, which
+         * allows readers on other connections to keep going while
+         * a write is in progress.  This sticks to the database
+         * file, not just this connection. */
+        result::ptr enable_wal(void);
+
+        /* Attaches an instrument to this connection, which will be
+         * told about every statement run, every time the database
+         * was found locked, and every transaction commit.  Passing
+         * NULL detaches it again. */
+        void set_instrument(const instrument::ptr& instrument);
+        const instrument::ptr& get_instrument(void) const
+            { return _instrument; }
+
+        /* Statistics for the prepared statement cache, which can
+         * be used to check that hot queries aren't being
+         * re-parsed. */
+        uint64_t statement_cache_hits(void) const
+            { return _stmts.hits(); }
+        uint64_t statement_cache_misses(void) const
+            { return _stmts.misses(); }
+
+        /* Changes the number of prepared statements that are kept
+         * around, 0 disables the cache entirely. */
+        void set_statement_cache_size(size_t size)
+            { _stmts.resize(size); }
+
+        /* Caches the results of select() and count() on the given
+         * table, so repeating a query doesn't touch SQLite at all
+         * until the table changes.  Every result handed out from
+         * the cache is shared, so they must not be modified. */
+        void enable_result_cache(const table::ptr& table);
+        void disable_result_cache(const table::ptr& table);
+
+        /* Limits the result cache to the given number of results,
+         * skipping any result with more than "max_rows" rows. */
+        void set_result_cache_size(size_t size, size_t max_rows)
+            { _results.resize(size, max_rows); }
+
+        /* Statistics for the result cache: an invalidation is every
+         * time some cached results were thrown away because their
+         * table changed. */
+        uint64_t result_cache_hits(void) const
+            { return _results.hits(); }
+        uint64_t result_cache_misses(void) const
+            { return _results.misses(); }
+        uint64_t result_cache_invalidations(void) const
+            { return _results.invalidations(); }
+
+    private:
+        /* Finds a prepared statement for the given SQL in the
+         * cache, or prepares a new one.  Returns NULL on failure,
+         * in which case the SQLite error is still pending on the
+         * database handle. */
+        statement::ptr prepare(const std::string& sql, bool cacheable);
+
+        /* Prepares a statement that consists of the given prefix
+         * followed by a printf-style WHERE clause.  When it's
+         * possible the arguments are bound as parameters, starting
+         * at "first", and otherwise they're escaped directly into
+         * the SQL text. */
+        statement::ptr prepare_where(const std::string& prefix,
+                                     int first,
+                                     const char *format,
+                                     va_list args);
+
+        /* Checks the plan for the given statement's shape, unless
+         * it's already been checked, see set_plan_check(). */
+        void check_plan(const statement::ptr& stmt);
+
+        /* Prepares the SELECT statement used by scan(). */
+        statement::ptr prepare_select(const table::ptr& table,
+                                      const std::vector<column::ptr>& c,
+                                      const char *format,
+                                      va_list args);
+
+        /* Prepares the INSERT statement for the given columns. */
+        statement::ptr prepare_insert(const table::ptr& table,
+                                      const std::vector<std::string>& cols);
+
+        /* Runs a prepared statement that doesn't return any rows,
+         * giving it back to the cache. */
+        enum error_code run(const statement::ptr& stmt);
+
+        /* Runs a prepared statement to completion, collecting
+         * every row it returns and then giving it back to the
+         * cache. */
+        result::ptr execute(const statement::ptr& stmt);
+        result::ptr execute(const cursor::ptr& cur);
+
+        /* Like execute(), but checks the result cache first when
+         * it's enabled for the given table. */
+        result::ptr execute_cached(const table::ptr& table,
+                                   const statement::ptr& stmt);
+
+        /* Runs a fixed SQL command that doesn't take any
+         * arguments. */
+        result::ptr execute(const std::string& sql);
+
+        /* Builds a result from the error that's currently pending
+         * on the database handle. */
+        result::ptr error_result(void);
+
+        /* Records that a transaction was just opened. */
+        void transaction_started(void);
+
+        /* Installs either SQLite's own busy timeout or our busy
+         * callback, depending on what's needed. */
+        void update_busy_handler(void);
+        static int busy_callback(void *conn, int count);
+
+        /* Keeps the result cache up to date: SQLite tells us about
+         * every row this connection changes and every rollback,
+         * and changes from other connections are found by checking
+         * the data version. */
+        void check_data_version(void);
+        static void update_callback(void *conn,
+                                    int op,
+                                    const char *db,
+                                    const char *table,
+                                    sqlite3_int64 rowid);
+        static void rollback_callback(void *conn);
+
     protected:
         /* This is really only allowed to be called from transaction. */
         friend class transaction;
         result::ptr commit_transaction(void);
+
+        /* Cursors hand their statements back here once they're
+         * done with them. */
+        friend class cursor;
+        void release(const statement::ptr& stmt);
+
+        /* Gets a statement ready to be profiled, returning its
+         * start time. */
+        std::chrono::steady_clock::time_point
+        start_profile(const statement::ptr& stmt);
+
+        /* Tells the instrument about a finished statement.  This
+         * must be called before the statement is released. */
+        void profile(const statement::ptr& stmt,
+                     uint64_t rows,
+                     std::chrono::steady_clock::time_point start);
     };
 }
 
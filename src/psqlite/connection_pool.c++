@@ -0,0 +1,129 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#include "connection_pool.h++"
+#include <stdlib.h>
+using namespace psqlite;
+
+connection_pool::connection_pool(const std::string& path, size_t readers)
+    : _path(path),
+      _all(),
+      _lock(),
+      _available(),
+      _idle_readers(),
+      _writer(NULL),
+      _writer_idle(true),
+      _out(0)
+{
+    /* The writer has to come first: it's the one that's allowed to
+     * create the database, and it's also the one that switches it
+     * over to WAL mode. */
+    _all.push_back(std::unique_ptr<connection>(new connection(path)));
+    _writer = _all.back().get();
+
+    auto wal = _writer->enable_wal();
+    if (wal->result_count() != 1 || wal->rowi(0)->get_str("journal_mode") != "wal") {
+        fprintf(stderr, "Unable to put '%s' into WAL mode\n", path.c_str());
+        abort();
+    }
+
+    for (size_t i = 0; i < readers; ++i) {
+        _all.push_back(std::unique_ptr<connection>(
+                           new connection(path, SQLITE_OPEN_READONLY)));
+        _idle_readers.push_back(_all.back().get());
+    }
+}
+
+connection_pool::~connection_pool(void)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    if (_out != 0) {
+        fprintf(stderr, "connection_pool destroyed with %lu connections out\n",
+                (unsigned long)_out);
+        abort();
+    }
+}
+
+connection::ptr connection_pool::reader(void)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    if (_all.size() == 1) {
+        fprintf(stderr, "Attempted to read from a pool without readers\n");
+        abort();
+    }
+
+    _available.wait(lock, [this]{ return !_idle_readers.empty(); });
+    auto conn = _idle_readers.back();
+    _idle_readers.pop_back();
+    _out++;
+
+    auto out = connection::ptr(conn, [this](connection *c) { give_back(c); });
+    conn->_self = out;
+    return out;
+}
+
+connection::ptr connection_pool::writer(void)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    _available.wait(lock, [this]{ return _writer_idle; });
+    _writer_idle = false;
+    _out++;
+
+    auto out = connection::ptr(_writer, [this](connection *c) { give_back(c); });
+    _writer->_self = out;
+    return out;
+}
+
+psqlite::immediate_transaction::ptr connection_pool::immediate_transaction(void)
+{
+    /* The transaction only has a raw pointer to its connection, so
+     * this keeps the writer checked out alongside it.  Members are
+     * destroyed in reverse order, so the transaction commits before
+     * the writer is given back. */
+    struct held {
+        connection::ptr writer;
+        psqlite::immediate_transaction::ptr tr;
+    };
+
+    auto h = std::make_shared<held>();
+    h->writer = writer();
+    h->tr = h->writer->immediate_transaction();
+    if (h->tr == NULL)
+        return NULL;
+    return psqlite::immediate_transaction::ptr(h, h->tr.get());
+}
+
+void connection_pool::set_busy_timeout(int ms)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    for (const auto& conn: _all)
+        conn->set_busy_timeout(ms);
+}
+
+void connection_pool::set_busy_handler(const std::function<bool(int)>& handler)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    for (const auto& conn: _all)
+        conn->set_busy_handler(handler);
+}
+
+void connection_pool::set_instrument(const instrument::ptr& instrument)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    for (const auto& conn: _all)
+        conn->set_instrument(instrument);
+}
+
+void connection_pool::give_back(connection *conn)
+{
+    {
+        std::unique_lock<std::mutex> lock(_lock);
+        if (conn == _writer)
+            _writer_idle = true;
+        else
+            _idle_readers.push_back(conn);
+        _out--;
+    }
+
+    _available.notify_all();
+}
@@ -0,0 +1,83 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#ifndef PSQLITE__CONNECTION_POOL_HXX
+#define PSQLITE__CONNECTION_POOL_HXX
+
+#include <memory>
+#include <condition_variable>
+#include "connection.h++"
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace psqlite {
+    /* Holds a set of connections to a single database file, which
+     * can safely be shared between threads.  The database is put
+     * into WAL mode, which lets any number of readers run at the
+     * same time as a single writer, so the pool hands out a
+     * number of read-only connections and exactly one connection
+     * that's allowed to write.  Note that this doesn't work with
+     * ":memory:" databases, as every connection to one of those
+     * gets its own database. */
+    class connection_pool {
+    public:
+        typedef std::shared_ptr<connection_pool> ptr;
+
+    private:
+        const std::string _path;
+
+        /* Every connection the pool has ever opened, which are
+         * owned by the pool and just lent out. */
+        std::vector<std::unique_ptr<connection>> _all;
+
+        /* Protects everything below. */
+        std::mutex _lock;
+        std::condition_variable _available;
+        std::vector<connection *> _idle_readers;
+        connection *_writer;
+        bool _writer_idle;
+        size_t _out;
+
+    public:
+        /* Opens the given number of read-only connections, along
+         * with a single writer, to the database at "path". */
+        connection_pool(const std::string& path, size_t readers);
+
+        /* It's a fatal error to destroy a pool while any of its
+         * connections are still checked out. */
+        ~connection_pool(void);
+
+    public:
+        /* Checks out a connection, waiting for one to become free
+         * if necessary.  The connection is returned to the pool
+         * when the last reference to it goes away, and must only
+         * be used by one thread at a time until then.  Cursors
+         * from the connection count as references, so the
+         * connection stays checked out until they're done. */
+        connection::ptr reader(void);
+        connection::ptr writer(void);
+
+        /* Opens an immediate transaction on the writer, which stays
+         * checked out until the transaction is committed.  The
+         * writer itself can be reached via conn().  Returns NULL
+         * if another process kept the database locked. */
+        psqlite::immediate_transaction::ptr immediate_transaction(void);
+
+        /* Sets the busy handling for every connection in the
+         * pool, see connection::set_busy_timeout().  These should
+         * be called before any connections are checked out. */
+        void set_busy_timeout(int ms);
+        void set_busy_handler(const std::function<bool(int)>& handler);
+
+        /* Attaches the same instrument to every connection in the
+         * pool, see connection::set_instrument(). */
+        void set_instrument(const instrument::ptr& instrument);
+
+    private:
+        void give_back(connection *conn);
+    };
+}
+
+#endif
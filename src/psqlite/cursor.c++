@@ -0,0 +1,114 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#include "cursor.h++"
+#include "connection.h++"
+#include <stdlib.h>
+using namespace psqlite;
+
+cursor::cursor(connection *conn, const statement::ptr& stmt)
+    : _conn(conn),
+      _owner(conn->_self.lock()),
+      _stmt(stmt),
+      _row(NULL),
+      _started(false),
+      _status(std::make_shared<result>()),
+      _rows(0),
+      _start()
+{
+}
+
+cursor::cursor(connection *conn, const result::ptr& status)
+    : _conn(conn),
+      _owner(NULL),
+      _stmt(NULL),
+      _row(NULL),
+      _started(true),
+      _status(status),
+      _rows(0),
+      _start()
+{
+}
+
+cursor::~cursor(void)
+{
+    close();
+}
+
+bool cursor::step(void)
+{
+    retire_row();
+
+    if (_stmt == NULL)
+        return false;
+
+    if (_started == false && _conn->get_instrument() != NULL)
+        _start = _conn->start_profile(_stmt);
+    _started = true;
+
+    int error = _stmt->step();
+    if (error != SQLITE_ROW) {
+        if (error == SQLITE_DONE)
+            finish(SQLITE_OK, "");
+        else
+            finish(error, sqlite3_errmsg(sqlite3_db_handle(_stmt->handle())));
+        return false;
+    }
+
+    /* The row is reused for every step unless someone else is still
+     * holding onto it, in which case it needs its own copy of the
+     * data before moving on. */
+    if (_row == NULL)
+        _row = row::ptr(new row(_stmt->columns()));
+    _row->load(_stmt->handle());
+    _rows++;
+
+    return true;
+}
+
+void cursor::close(void)
+{
+    if (_stmt == NULL)
+        return;
+
+    /* Closing a cursor early isn't an error, it just means nobody
+     * wanted the rest of the rows. */
+    finish(SQLITE_OK, "");
+}
+
+enum error_code cursor::return_value(void) const
+{
+    return _status->return_value();
+}
+
+const std::string& cursor::return_string(void) const
+{
+    return _status->return_string();
+}
+
+cursor::iterator cursor::begin(void)
+{
+    if (_started == false)
+        step();
+
+    return iterator(this);
+}
+
+void cursor::finish(int code, const std::string& str)
+{
+    _status->set_error(code, str);
+    retire_row();
+    _row = NULL;
+    if (_conn->get_instrument() != NULL && _start != std::chrono::steady_clock::time_point())
+        _conn->profile(_stmt, _rows, _start);
+    _conn->release(_stmt);
+    _stmt = NULL;
+}
+
+void cursor::retire_row(void)
+{
+    if (_row != NULL && _row.use_count() > 1) {
+        _row->detach();
+        _row = NULL;
+    }
+}
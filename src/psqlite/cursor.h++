@@ -0,0 +1,155 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#ifndef PSQLITE__CURSOR_HXX
+#define PSQLITE__CURSOR_HXX
+
+#include <memory>
+#include <chrono>
+#include "result.h++"
+#include "row.h++"
+#include "statement.h++"
+#include <stdint.h>
+#include <string>
+
+namespace psqlite {
+    class connection;
+}
+
+namespace psqlite {
+    /* Steps through the rows returned by a query one at a time,
+     * rather than reading them all in before returning like a
+     * result does.  Note that a cursor holds onto a running
+     * statement, so it must not outlive the connection it came
+     * from.  Cursors from a connection that was checked out of a
+     * connection_pool keep it checked out until they're done. */
+    class cursor {
+    public:
+        typedef std::shared_ptr<cursor> ptr;
+
+        /* Allows a cursor to be used in a range-based for loop.
+         * These are single-pass iterators: incrementing one steps
+         * the underlying cursor. */
+        class iterator {
+        private:
+            cursor *_c;
+
+        public:
+            iterator(cursor *c)
+                : _c(c)
+                {
+                }
+
+        public:
+            const row::ptr& operator*(void) const
+                { return _c->current(); }
+            const row::ptr *operator->(void) const
+                { return &_c->current(); }
+
+            iterator& operator++(void)
+                {
+                    _c->step();
+                    return *this;
+                }
+
+            bool operator==(const iterator& that) const
+                { return done() == that.done(); }
+            bool operator!=(const iterator& that) const
+                { return done() != that.done(); }
+
+        private:
+            bool done(void) const
+                { return (_c == NULL) || _c->done(); }
+        };
+
+    private:
+        /* Like transaction, this is explicitly not a shared
+         * pointer because cursors are handed out by the
+         * connection. */
+        connection *_conn;
+
+        /* Keeps pooled connections checked out for as long as the
+         * cursor exists, so nobody else can use the connection out
+         * from under it.  This is NULL for connections that aren't
+         * from a pool. */
+        std::shared_ptr<connection> _owner;
+
+        /* The statement that's being stepped, which goes back to
+         * the connection as soon as the last row has been read
+         * (or the cursor is closed). */
+        statement::ptr _stmt;
+
+        /* The row that the cursor currently points at, whose
+         * values point directly into the statement. */
+        row::ptr _row;
+        bool _started;
+
+        /* Holds the final SQLite return code, which is only set
+         * once the statement has finished. */
+        result::ptr _status;
+
+        /* These are used to profile the statement, but only when
+         * the connection has an instrument attached. */
+        uint64_t _rows;
+        std::chrono::steady_clock::time_point _start;
+
+    public:
+        /* Creates a cursor that steps through the given prepared
+         * statement, which must already have its arguments
+         * bound. */
+        cursor(connection *conn, const statement::ptr& stmt);
+
+        /* Creates a cursor that has already failed, for when the
+         * statement couldn't even be prepared. */
+        cursor(connection *conn, const result::ptr& status);
+
+        ~cursor(void);
+
+    public:
+        /* Moves to the next row, returning FALSE when there are no
+         * more rows to read.  The first call moves to the first
+         * row. */
+        bool step(void);
+
+        /* Returns TRUE once every row has been read, or the cursor
+         * has been closed. */
+        bool done(void) const
+            { return _stmt == NULL; }
+
+        /* Returns the row the cursor is currently pointing at. */
+        const row::ptr& current(void) const
+            { return _row; }
+
+        /* Stops reading rows early, giving the statement back to
+         * the connection. */
+        void close(void);
+
+        /* The same as result's error codes.  Note that you can
+         * only call these once the cursor is done(). */
+        enum error_code return_value(void) const;
+        const std::string& return_string(void) const;
+
+        /* Range-based for loop support, which starts stepping the
+         * cursor if that hasn't already happened. */
+        iterator begin(void);
+        iterator end(void)
+            { return iterator(NULL); }
+
+    private:
+        void finish(int code, const std::string& str);
+
+        /* Stops pointing at the current row, making sure that
+         * anyone else who holds it gets their own copy. */
+        void retire_row(void);
+    };
+
+    /* These allow the cursors returned by connection::scan() to be
+     * used directly in a range-based for loop, which keeps the
+     * cursor alive for the whole loop. */
+    inline cursor::iterator begin(const cursor::ptr& c)
+    { return c->begin(); }
+    inline cursor::iterator end(const cursor::ptr& c)
+    { return c->end(); }
+}
+
+#endif
@@ -0,0 +1,97 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#include "datum.h++"
+#include <sqlite3.h>
+using namespace psqlite;
+
+datum datum::integer(int64_t i)
+{
+    datum out;
+    out._type = datum_type::INTEGER;
+    out._u.i = i;
+    return out;
+}
+
+datum datum::real(double d)
+{
+    datum out;
+    out._type = datum_type::FLOAT;
+    out._u.d = d;
+    return out;
+}
+
+datum datum::text(const char *data, size_t size)
+{
+    datum out;
+    out._type = datum_type::TEXT;
+    out._u.p = data;
+    out._size = size;
+    return out;
+}
+
+datum datum::blob(const void *data, size_t size)
+{
+    datum out;
+    out._type = datum_type::BLOB;
+    out._u.p = (const char *)data;
+    out._size = size;
+    return out;
+}
+
+int64_t datum::as_int64(void) const
+{
+    switch (_type) {
+    case datum_type::INTEGER:
+        return _u.i;
+    case datum_type::FLOAT:
+        return _u.d;
+    case datum_type::TEXT:
+    case datum_type::BLOB:
+        return strtoll(as_str().c_str(), NULL, 10);
+    case datum_type::NONE:
+        return 0;
+    }
+
+    return 0;
+}
+
+double datum::as_double(void) const
+{
+    switch (_type) {
+    case datum_type::INTEGER:
+        return _u.i;
+    case datum_type::FLOAT:
+        return _u.d;
+    case datum_type::TEXT:
+    case datum_type::BLOB:
+        return strtod(as_str().c_str(), NULL);
+    case datum_type::NONE:
+        return 0;
+    }
+
+    return 0;
+}
+
+std::string datum::as_str(void) const
+{
+    switch (_type) {
+    case datum_type::INTEGER:
+        return std::to_string(_u.i);
+    case datum_type::FLOAT:
+    {
+        /* This is the format SQLite itself uses when converting
+         * floats to text. */
+        char buffer[64];
+        sqlite3_snprintf(64, buffer, "%!.15g", _u.d);
+        return buffer;
+    }
+    case datum_type::TEXT:
+    case datum_type::BLOB:
+        return std::string(_u.p, _size);
+    case datum_type::NONE:
+        return "";
+    }
+
+    return "";
+}
@@ -0,0 +1,77 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#ifndef PSQLITE__DATUM_HXX
+#define PSQLITE__DATUM_HXX
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+namespace psqlite {
+    /* The storage classes that SQLite knows about.  NONE is what
+     * SQL calls NULL. */
+    enum class datum_type {
+        INTEGER,
+        FLOAT,
+        TEXT,
+        BLOB,
+        NONE,
+    };
+
+    /* A single typed value, as read out of a column.  Text and blob
+     * data isn't owned by the datum, it lives in whatever arena the
+     * row or result it came from manages. */
+    class datum {
+    private:
+        union {
+            int64_t i;
+            double d;
+            const char *p;
+        } _u;
+        int _size;
+        datum_type _type;
+
+    public:
+        /* Creates a NULL datum. */
+        datum(void)
+            : _size(0),
+              _type(datum_type::NONE)
+            {
+                _u.p = NULL;
+            }
+
+        static datum integer(int64_t i);
+        static datum real(double d);
+        static datum text(const char *data, size_t size);
+        static datum blob(const void *data, size_t size);
+
+    public:
+        datum_type type(void) const { return _type; }
+        bool is_null(void) const { return _type == datum_type::NONE; }
+
+        /* Text and blob bytes, which aren't necessarily
+         * NUL-terminated. */
+        const char *data(void) const
+            { return has_bytes() ? _u.p : NULL; }
+        size_t size(void) const { return _size; }
+        bool has_bytes(void) const
+            {
+                return (_type == datum_type::TEXT)
+                    || (_type == datum_type::BLOB);
+            }
+
+        /* Points a text or blob datum at a new copy of its
+         * bytes. */
+        void set_data(const char *data) { _u.p = data; }
+
+        /* Reads the value, converting between types the same way
+         * SQLite would.  Note that integers and floats are only
+         * parsed when they were stored as text. */
+        int64_t as_int64(void) const;
+        double as_double(void) const;
+        std::string as_str(void) const;
+    };
+}
+
+#endif
@@ -0,0 +1,29 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#include "error_code.h++"
+#include <stdio.h>
+#include <stdlib.h>
+using namespace psqlite;
+
+enum error_code psqlite::to_error_code(int code, const std::string& str)
+{
+    switch (code) {
+    case 0:
+        return error_code::SUCCESS;
+
+    case 5:
+        return error_code::FAILED_BUSY;
+
+    case 19:
+        return error_code::FAILED_UNIQUE;
+
+    default:
+        fprintf(stderr, "Unknown SQLite error code %d\n", code);
+        fprintf(stderr, "  Associated string: '%s'\n", str.c_str());
+        abort();
+        break;
+    }
+
+    return error_code::SUCCESS;
+}
@@ -10,8 +10,23 @@
 namespace psqlite {
     enum class error_code {
         SUCCESS = 0,
+
+        /* The database was locked by another connection, and the
+         * busy handler (or timeout) gave up waiting for it.  It's
+         * safe to try again. */
+        FAILED_BUSY = 5,
+
         FAILED_UNIQUE = 19,
+
+        /* This one doesn't come from SQLite: it's returned for a
+         * row that's missing one of the columns needed to find it
+         * (see connection::replace_many()). */
+        FAILED_MISSING_KEY = -1,
     };
+
+    /* Converts a SQLite return code into one of the above.  Any
+     * error that there's no code for is fatal. */
+    enum error_code to_error_code(int code, const std::string& str);
 }
 
 #endif
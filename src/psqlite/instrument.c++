@@ -0,0 +1,17 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#include "instrument.h++"
+using namespace psqlite;
+
+instrument::~instrument(void)
+{
+}
+
+void instrument::busy_retry(int count __attribute__((unused)))
+{
+}
+
+void instrument::transaction_finished(uint64_t nanoseconds __attribute__((unused)))
+{
+}
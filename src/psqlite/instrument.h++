@@ -0,0 +1,64 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#ifndef PSQLITE__INSTRUMENT_HXX
+#define PSQLITE__INSTRUMENT_HXX
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+namespace psqlite {
+    /* Everything that's known about a single run of a statement. */
+    struct statement_profile {
+        /* Wall-clock time from the first step until the statement
+         * was finished (or closed early). */
+        uint64_t nanoseconds;
+
+        /* The number of rows handed back to the caller. */
+        uint64_t rows;
+
+        /* These come straight from sqlite3_stmt_status(): the
+         * number of rows visited by full table scans, the number
+         * of sorts, the number of automatic indexes that had to be
+         * built, and the number of virtual machine steps (which is
+         * a decent proxy for the total amount of work done). */
+        uint64_t fullscan_steps;
+        uint64_t sorts;
+        uint64_t autoindexes;
+        uint64_t vm_steps;
+    };
+
+    /* A sink for performance data from a connection.  Nothing is
+     * measured unless one of these is attached, and every callback
+     * may be called from whatever thread is using the connection,
+     * so implementations that are shared between connections need
+     * to do their own locking. */
+    class instrument {
+    public:
+        typedef std::shared_ptr<instrument> ptr;
+
+    public:
+        virtual ~instrument(void);
+
+    public:
+        /* Called every time a statement finishes.  The SQL is the
+         * statement's template (with "?N" parameters, or the
+         * printf-style format for WHERE clauses that couldn't be
+         * turned into parameters), so every run of the same query
+         * shape shows up with the same text. */
+        virtual void statement_finished(const std::string& sql,
+                                        const statement_profile& p) = 0;
+
+        /* Called every time SQLite finds the database locked and
+         * has to retry, "count" being the number of retries so far
+         * for this lock. */
+        virtual void busy_retry(int count);
+
+        /* Called when a transaction is committed, with the time
+         * since it was opened. */
+        virtual void transaction_finished(uint64_t nanoseconds);
+    };
+}
+
+#endif
@@ -6,7 +6,10 @@
 using namespace psqlite;
 
 result::result(void)
-    : _return_set(false)
+    : _return_set(false),
+      _storage(std::make_shared<storage>()),
+      _count(0),
+      _data()
 {
 }
 
@@ -27,32 +30,93 @@ void result::set_error(int code, std::string str)
         abort();
     }
 
-    switch (code) {
-    case 0:
-        _return_value = error_code::SUCCESS;
-        break;
+    _return_value = to_error_code(code, str);
+    _return_string = str;
+    _return_set = true;
+}
 
-    case 19:
-        _return_value = error_code::FAILED_UNIQUE;
-        break;
+void result::add_map(const std::map<std::string, std::string>& m)
+{
+    add_row(psqlite::row(m));
+}
 
-    default:
-        fprintf(stderr, "Unknown SQLite error code %d\n", code);
-        fprintf(stderr, "  Associated string: '%s'\n", str.c_str());
+void result::add_row(const row& row)
+{
+    if (_return_set == true) {
+        fprintf(stderr, "add_row() called after set_return()\n");
         abort();
-        break;
     }
 
-    _return_string = str;
-    _return_set = true;
+    /* The first row decides what columns this result has. */
+    auto& s = *_storage;
+    if (s.columns == NULL)
+        s.columns = row.column_schema();
+
+    auto copy = [&](const datum& d)
+        {
+            auto out = d;
+            if (out.has_bytes())
+                out.set_data(s.bytes.copy(d.data(), d.size()));
+            s.slots.push_back(out);
+        };
+
+    if (row.column_schema() == s.columns) {
+        for (size_t i = 0; i < row.size(); ++i)
+            copy(row.get(i));
+    } else {
+        /* Rows built from maps leave NULL columns out entirely, so
+         * it's necessary to match them up by name. */
+        size_t found = 0;
+        for (size_t i = 0; i < s.columns->size(); ++i) {
+            size_t index;
+            if (row.column_schema()->find(s.columns->name(i), &index)) {
+                copy(row.get(index));
+                found++;
+            } else {
+                s.slots.push_back(datum());
+            }
+        }
+
+        if (found != row.columns().size()) {
+            fprintf(stderr, "add_row() called with mismatched columns\n");
+            abort();
+        }
+    }
+
+    _count++;
 }
 
-void result::add_map(const std::map<std::string, std::string>& m)
+size_t result::column_count(void) const
 {
-    if (_return_set == true) {
-        fprintf(stderr, "add_map() called after set_return()\n");
+    if (_storage->columns == NULL)
+        return 0;
+    return _storage->columns->size();
+}
+
+bool result::find_column(const std::string& name, size_t *index) const
+{
+    if (_storage->columns == NULL)
+        return false;
+    return _storage->columns->find(name, index);
+}
+
+const std::vector<row::ptr>& result::rows(void) const
+{
+    if (_return_set == false) {
+        fprintf(stderr, "rows() called before set_error()\n");
         abort();
     }
 
-    _data.push_back(std::make_shared<psqlite::row>(m));
+    if (_data.size() != _count) {
+        auto width = column_count();
+        _data.reserve(_count);
+        for (size_t i = 0; i < _count; ++i) {
+            auto values = _storage->slots.data() + i * width;
+            _data.push_back(std::make_shared<psqlite::row>(_storage->columns,
+                                                           values,
+                                                           _storage));
+        }
+    }
+
+    return _data;
 }
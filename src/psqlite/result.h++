@@ -5,18 +5,41 @@
 #define PSQLITE__RESULT_HXX
 
 #include <memory>
+#include "arena.h++"
+#include "datum.h++"
 #include "error_code.h++"
 #include "row.h++"
+#include "schema.h++"
 #include <map>
 #include <string>
 #include <vector>
 
 namespace psqlite {
-    /* Holds the result of a SQL command. */
+    /* Holds the result of a SQL command.  Note that this reads
+     * every row into memory, see cursor for a way to step through
+     * large results without doing so. */
     class result {
     public:
         typedef std::shared_ptr<result> ptr;
 
+    private:
+        /* The actual return data is stored as one big array of
+         * values (one slot per column, row after row), with all the
+         * text living in an arena.  Rows handed out by rowi() keep
+         * this alive on their own. */
+        struct storage {
+            schema::ptr columns;
+            std::vector<datum> slots;
+            arena bytes;
+
+            storage(void)
+                : columns(NULL),
+                  slots(),
+                  bytes(16384)
+                {
+                }
+        };
+
     private:
         /* Here we handle the return code from SQLite.*/
         bool _return_set;
@@ -25,7 +48,14 @@ namespace psqlite {
 
         /* This contains the actual return data, which is the
          * whole point of this object. */
-        std::vector<row::ptr> _data;
+        std::shared_ptr<storage> _storage;
+        size_t _count;
+
+        /* The row objects are only built if someone asks for
+         * them, which isn't thread-safe.  Results that are shared
+         * (like the ones in a result_cache) must have them built
+         * before they're shared. */
+        mutable std::vector<row::ptr> _data;
 
     public:
         /* Creates a new result set that hasn't yet been
@@ -43,19 +73,37 @@ namespace psqlite {
          * and makes it usable. */
         void set_error(int code, std::string str);
 
-        /* Adds an entry to the list of results. */
+        /* Adds an entry to the list of results, copying its
+         * values. */
         void add_map(const std::map<std::string, std::string>& m);
+        void add_row(const row& row);
+        void add_row(const row::ptr& row)
+            { add_row(*row); }
 
         /* Returns the number of results that exist in this
          * entry. */
         size_t result_count(void) const
-            { return _data.size(); }
+            { return _count; }
+
+        /* The columns in this result, which are shared by every
+         * row.  Note that a result without any rows may not know
+         * its columns. */
+        size_t column_count(void) const;
+        const std::string& column_name(size_t i) const
+            { return _storage->columns->name(i); }
+        bool find_column(const std::string& name, size_t *index) const;
+
+        /* Directly reads a single value, which avoids building
+         * row objects at all. */
+        const datum& get(size_t row, size_t column) const
+            { return _storage->slots[row * column_count() + column]; }
 
-        /* Returns a single row from the listing. */
+        /* Returns a single row from the listing.  These are
+         * built on demand, and can only be used once the result
+         * has been finalized. */
         const row::ptr& rowi(size_t i) const
-            { return _data[i]; }
-        const std::vector<row::ptr>& rows(void) const
-            { return _data; }
+            { return rows()[i]; }
+        const std::vector<row::ptr>& rows(void) const;
     };
 }
 
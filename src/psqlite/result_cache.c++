@@ -0,0 +1,110 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#include "result_cache.h++"
+#include <iterator>
+using namespace psqlite;
+
+result_cache::result_cache(size_t capacity, size_t max_rows)
+    : _capacity(capacity),
+      _max_rows(max_rows),
+      _enabled(),
+      _lru(),
+      _index(),
+      _tables(),
+      _hits(0),
+      _misses(0),
+      _invalidations(0)
+{
+}
+
+void result_cache::enable(const std::string& table)
+{
+    _enabled.insert(table);
+}
+
+void result_cache::disable(const std::string& table)
+{
+    _enabled.erase(table);
+    invalidate(table);
+}
+
+result::ptr result_cache::find(const std::string& key)
+{
+    auto l = _index.find(key);
+    if (l == _index.end()) {
+        _misses++;
+        return NULL;
+    }
+
+    _lru.splice(_lru.begin(), _lru, l->second);
+    _hits++;
+    return l->second->value;
+}
+
+void result_cache::insert(const std::string& key,
+                          const std::string& table,
+                          const result::ptr& value)
+{
+    if (_capacity == 0 || value->result_count() > _max_rows)
+        return;
+
+    auto l = _index.find(key);
+    if (l != _index.end())
+        erase(l->second);
+
+    _lru.push_front(entry{key, table, value});
+    _index[key] = _lru.begin();
+    _tables[table]++;
+    evict();
+}
+
+void result_cache::invalidate(const std::string& table)
+{
+    /* This gets called for every row that's written, so it needs to
+     * be fast when there's nothing to do. */
+    auto t = _tables.find(table);
+    if (t == _tables.end())
+        return;
+
+    for (auto it = _lru.begin(); it != _lru.end();) {
+        auto next = std::next(it);
+        if (it->table == table)
+            erase(it);
+        it = next;
+    }
+    _invalidations++;
+}
+
+void result_cache::clear(void)
+{
+    if (!_lru.empty())
+        _invalidations++;
+
+    _index.clear();
+    _tables.clear();
+    _lru.clear();
+}
+
+void result_cache::resize(size_t capacity, size_t max_rows)
+{
+    _capacity = capacity;
+    _max_rows = max_rows;
+    evict();
+}
+
+void result_cache::evict(void)
+{
+    while (_lru.size() > _capacity)
+        erase(std::prev(_lru.end()));
+}
+
+void result_cache::erase(std::list<entry>::iterator it)
+{
+    auto t = _tables.find(it->table);
+    if (--t->second == 0)
+        _tables.erase(t);
+
+    _index.erase(it->key);
+    _lru.erase(it);
+}
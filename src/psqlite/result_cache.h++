@@ -0,0 +1,91 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#ifndef PSQLITE__RESULT_CACHE_HXX
+#define PSQLITE__RESULT_CACHE_HXX
+
+#include <list>
+#include "result.h++"
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace psqlite {
+    /* A least-recently-used cache of query results, keyed by the
+     * SQL text they came from (with every parameter filled in).
+     * Only tables that have been explicitly enabled are cached, and
+     * every result is tagged with its table so it can be thrown
+     * away as soon as that table changes.  Cached results are
+     * handed out to everyone who asks, so they must never be
+     * modified. */
+    class result_cache {
+    private:
+        struct entry {
+            std::string key;
+            std::string table;
+            result::ptr value;
+        };
+
+        size_t _capacity;
+        size_t _max_rows;
+
+        /* The tables whose results may be cached. */
+        std::unordered_set<std::string> _enabled;
+
+        /* The most recently used result lives at the front. */
+        std::list<entry> _lru;
+        std::unordered_map<std::string, std::list<entry>::iterator> _index;
+
+        /* The number of cached results for every table, so that
+         * writes to a table with nothing cached are cheap. */
+        std::unordered_map<std::string, size_t> _tables;
+
+        uint64_t _hits;
+        uint64_t _misses;
+        uint64_t _invalidations;
+
+    public:
+        result_cache(size_t capacity, size_t max_rows);
+
+    public:
+        /* Controls which tables can be cached. */
+        void enable(const std::string& table);
+        void disable(const std::string& table);
+        bool enabled(const std::string& table) const
+            { return !_enabled.empty() && _enabled.count(table) != 0; }
+        bool any_enabled(void) const { return !_enabled.empty(); }
+
+        /* Looks up a cached result, returning NULL if there isn't
+         * one. */
+        result::ptr find(const std::string& key);
+
+        /* Adds a result to the cache, unless it's too big to be
+         * worth keeping. */
+        void insert(const std::string& key,
+                    const std::string& table,
+                    const result::ptr& value);
+
+        /* Drops every result that came from the given table. */
+        void invalidate(const std::string& table);
+
+        /* Drops every cached result. */
+        void clear(void);
+
+        /* Changes the maximum number of cached results, and the
+         * largest result (in rows) that will be cached. */
+        void resize(size_t capacity, size_t max_rows);
+
+        size_t size(void) const { return _lru.size(); }
+        size_t capacity(void) const { return _capacity; }
+        uint64_t hits(void) const { return _hits; }
+        uint64_t misses(void) const { return _misses; }
+        uint64_t invalidations(void) const { return _invalidations; }
+
+    private:
+        void evict(void);
+        void erase(std::list<entry>::iterator it);
+    };
+}
+
+#endif
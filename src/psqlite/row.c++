@@ -9,34 +9,70 @@ template<class K, class V>
 static std::vector<K> map_keys(const std::map<K, V>& m);
 
 row::row(const std::map<std::string, std::string>& m)
-    : _columns(map_keys(m)),
-      _m(m)
+    : _schema(std::make_shared<schema>(map_keys(m))),
+      _values(NULL),
+      _owner(),
+      _own(),
+      _bytes(256)
 {
+    _own.reserve(m.size());
+    for (const auto& pair: m) {
+        auto copy = _bytes.copy(pair.second.c_str(), pair.second.size());
+        _own.push_back(datum::text(copy, pair.second.size()));
+    }
+    _values = _own.data();
 }
 
-std::string row::get_str(const std::string& col)
+row::row(const schema::ptr& schema,
+         const datum *values,
+         const std::shared_ptr<const void>& owner)
+    : _schema(schema),
+      _values(values),
+      _owner(owner),
+      _own(),
+      _bytes(256)
 {
-    auto l = _m.find(col);
-    if (l == _m.end()) {
-        fprintf(stderr, "Unable to find column '%s'\n", col.c_str());
-        abort();
-    }
+}
+
+row::row(const row& that)
+    : _schema(that._schema),
+      _values(NULL),
+      _owner(),
+      _own(that._values, that._values + that.size()),
+      _bytes(256)
+{
+    _values = _own.data();
+    detach();
+}
+
+row::row(const schema::ptr& schema)
+    : _schema(schema),
+      _values(NULL),
+      _owner(),
+      _own(schema->size()),
+      _bytes(256)
+{
+    _values = _own.data();
+}
 
-    return l->second;
+std::string row::get_str(const std::string& col) const
+{
+    return get(col).as_str();
 }
 
-unsigned row::get_uint(const std::string& col)
+unsigned row::get_uint(const std::string& col) const
 {
-    auto str = get_str(col);
-    auto uint = atoi(str.c_str());
+    auto& d = get(col);
+    auto uint = d.as_int64();
     if (uint < 0) {
-        fprintf(stderr, "Unable to parse '%s' as unsigned\n", str.c_str());
+        fprintf(stderr, "Unable to parse '%s' as unsigned\n",
+                d.as_str().c_str());
         abort();
     }
     return uint;
 }
 
-bool row::get_bool(const std::string& col)
+bool row::get_bool(const std::string& col) const
 {
     auto uint = get_uint(col);
     switch (uint) {
@@ -52,6 +88,86 @@ bool row::get_bool(const std::string& col)
     }
 }
 
+int64_t row::get_int64(const std::string& col) const
+{
+    return get(col).as_int64();
+}
+
+double row::get_double(const std::string& col) const
+{
+    return get(col).as_double();
+}
+
+std::vector<uint8_t> row::get_blob(const std::string& col) const
+{
+    auto& d = get(col);
+    return std::vector<uint8_t>(d.data(), d.data() + d.size());
+}
+
+const datum& row::get(const std::string& col) const
+{
+    size_t i;
+    if (_schema->find(col, &i) == false || _values[i].is_null()) {
+        fprintf(stderr, "Unable to find column '%s'\n", col.c_str());
+        abort();
+    }
+
+    return _values[i];
+}
+
+std::vector<std::string> row::columns(void) const
+{
+    std::vector<std::string> out;
+    for (size_t i = 0; i < size(); ++i)
+        if (_values[i].is_null() == false)
+            out.push_back(_schema->name(i));
+    return out;
+}
+
+void row::load(sqlite3_stmt *stmt)
+{
+    _bytes.clear();
+
+    for (size_t i = 0; i < _own.size(); ++i) {
+        switch (sqlite3_column_type(stmt, i)) {
+        case SQLITE_INTEGER:
+            _own[i] = datum::integer(sqlite3_column_int64(stmt, i));
+            break;
+
+        case SQLITE_FLOAT:
+            _own[i] = datum::real(sqlite3_column_double(stmt, i));
+            break;
+
+        case SQLITE_TEXT:
+        {
+            /* SQLite insists on fetching the pointer before the
+             * size. */
+            auto text = (const char *)sqlite3_column_text(stmt, i);
+            _own[i] = datum::text(text, sqlite3_column_bytes(stmt, i));
+            break;
+        }
+
+        case SQLITE_BLOB:
+        {
+            auto blob = sqlite3_column_blob(stmt, i);
+            _own[i] = datum::blob(blob, sqlite3_column_bytes(stmt, i));
+            break;
+        }
+
+        case SQLITE_NULL:
+            _own[i] = datum();
+            break;
+        }
+    }
+}
+
+void row::detach(void)
+{
+    for (auto& d: _own)
+        if (d.has_bytes())
+            d.set_data(_bytes.copy(d.data(), d.size()));
+}
+
 template<class K, class V>
 std::vector<K> map_keys(const std::map<K, V>& m)
 {
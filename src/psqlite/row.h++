@@ -5,7 +5,12 @@
 #define PSQLITE__ROW_HXX
 
 #include <memory>
+#include "arena.h++"
+#include "datum.h++"
 #include <map>
+#include "schema.h++"
+#include <sqlite3.h>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -16,31 +21,60 @@ namespace psqlite {
         typedef std::shared_ptr<row> ptr;
 
     private:
-        const std::vector<std::string> _columns;
-        const std::map<std::string, std::string> _m;
+        /* The names of this row's columns, which are shared with
+         * every other row from the same query. */
+        schema::ptr _schema;
+
+        /* One value for every column in the schema.  These either
+         * live inside a result (which "_owner" keeps alive), or in
+         * this row's own storage below. */
+        const datum *_values;
+        std::shared_ptr<const void> _owner;
+        std::vector<datum> _own;
+        arena _bytes;
 
     public:
         /* Creates a new row, given the data it contains. */
         row(const std::map<std::string, std::string>& m);
 
+        /* Creates a row that points at values that live somewhere
+         * else, which is how results hand out their rows. */
+        row(const schema::ptr& schema,
+            const datum *values,
+            const std::shared_ptr<const void>& owner);
+
+        row(const row& that);
+        row& operator=(const row& that) = delete;
+
     public:
         /* These provide a mechanism for obtaining access to
          * particular fields within this row. */
-        std::string get_str(const std::string& col);
-        unsigned get_uint(const std::string& col);
-        bool get_bool(const std::string& col);
+        std::string get_str(const std::string& col) const;
+        unsigned get_uint(const std::string& col) const;
+        bool get_bool(const std::string& col) const;
+
+        /* Typed accessors, which don't go through a string unless
+         * the value was actually stored as text. */
+        int64_t get_int64(const std::string& col) const;
+        double get_double(const std::string& col) const;
+        std::vector<uint8_t> get_blob(const std::string& col) const;
+
+        /* Direct access to the values, by index or by name. */
+        size_t size(void) const { return _schema->size(); }
+        const std::string& name(size_t i) const
+            { return _schema->name(i); }
+        const datum& get(size_t i) const { return _values[i]; }
+        const datum& get(const std::string& col) const;
+        const schema::ptr& column_schema(void) const
+            { return _schema; }
 
         /* Returns the list of the columns that are known to this
          * row.  This is guarnteed */
-        std::vector<std::string> columns(void) const
-            { return _columns; }
+        std::vector<std::string> columns(void) const;
 
         /* Returns the value associated with a column. */
         std::string value(const std::string& str) const
-            { 
-                auto l = _m.find(str);
-                return l->second;
-            }
+            { return get(str).as_str(); }
 
         /* Returns TRUE if the value exists in the map, and FALSE
          * otherwise.  Note that this is FALSE for NULL SQL
@@ -48,12 +82,23 @@ namespace psqlite {
          * SQL table at all! */
         bool has(const std::string& str) const
             {
-                auto l = _m.find(str);
-                if (l == _m.end())
+                size_t i;
+                if (_schema->find(str, &i) == false)
                     return false;
-                else
-                    return true;
+                return !_values[i].is_null();
             }
+
+    private:
+        /* Cursors reuse a single row for every step, reading the
+         * values straight out of SQLite without copying them. */
+        friend class cursor;
+        row(const schema::ptr& schema);
+        void load(sqlite3_stmt *stmt);
+
+        /* Copies any bytes this row points at into its own
+         * storage, which is necessary before the statement it was
+         * loaded from moves on. */
+        void detach(void);
     };
 }
 
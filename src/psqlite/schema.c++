@@ -0,0 +1,25 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#include "schema.h++"
+using namespace psqlite;
+
+schema::schema(const std::vector<std::string>& names)
+    : _names(names),
+      _index()
+{
+    /* When a name shows up twice the last one wins, which matches
+     * what happened when rows were stored as maps. */
+    for (size_t i = 0; i < _names.size(); ++i)
+        _index[_names[i]] = i;
+}
+
+bool schema::find(const std::string& name, size_t *index) const
+{
+    auto l = _index.find(name);
+    if (l == _index.end())
+        return false;
+
+    *index = l->second;
+    return true;
+}
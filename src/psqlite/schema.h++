@@ -0,0 +1,39 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#ifndef PSQLITE__SCHEMA_HXX
+#define PSQLITE__SCHEMA_HXX
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace psqlite {
+    /* The names of the columns returned by a query, in order.
+     * These are shared between every row of a result rather than
+     * being copied into each one. */
+    class schema {
+    public:
+        typedef std::shared_ptr<const schema> ptr;
+
+    private:
+        const std::vector<std::string> _names;
+        std::unordered_map<std::string, size_t> _index;
+
+    public:
+        schema(const std::vector<std::string>& names);
+
+    public:
+        size_t size(void) const { return _names.size(); }
+        const std::string& name(size_t i) const { return _names[i]; }
+        const std::vector<std::string>& names(void) const
+            { return _names; }
+
+        /* Looks up the index of a column by name, returning FALSE
+         * if there's no column with that name. */
+        bool find(const std::string& name, size_t *index) const;
+    };
+}
+
+#endif
@@ -0,0 +1,111 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#include "statement.h++"
+using namespace psqlite;
+
+statement::statement(sqlite3_stmt *stmt,
+                     const std::string& sql,
+                     bool cacheable)
+    : _stmt(stmt),
+      _sql(sql),
+      _cacheable(cacheable),
+      _shape(sql),
+      _reals(),
+      _columns(NULL)
+{
+}
+
+statement::~statement(void)
+{
+    sqlite3_finalize(_stmt);
+}
+
+void statement::bind_text(int i, const char *text, size_t length)
+{
+    sqlite3_bind_text(_stmt, i, text, length, SQLITE_TRANSIENT);
+}
+
+void statement::bind_int64(int i, int64_t value)
+{
+    sqlite3_bind_int64(_stmt, i, value);
+}
+
+void statement::bind_double(int i, double value)
+{
+    sqlite3_bind_double(_stmt, i, value);
+    _reals.append((const char *)&value, sizeof(value));
+}
+
+void statement::bind_null(int i)
+{
+    sqlite3_bind_null(_stmt, i);
+}
+
+void statement::bind(int i, const datum& value)
+{
+    switch (value.type()) {
+    case datum_type::INTEGER:
+        bind_int64(i, value.as_int64());
+        break;
+    case datum_type::FLOAT:
+        bind_double(i, value.as_double());
+        break;
+    case datum_type::TEXT:
+        bind_text(i, value.data(), value.size());
+        break;
+    case datum_type::BLOB:
+        sqlite3_bind_blob(_stmt, i, value.data(), value.size(),
+                          SQLITE_TRANSIENT);
+        break;
+    case datum_type::NONE:
+        bind_null(i);
+        break;
+    }
+}
+
+const schema::ptr& statement::columns(void)
+{
+    if (_columns == NULL) {
+        std::vector<std::string> names;
+        for (int i = 0; i < sqlite3_column_count(_stmt); ++i)
+            names.push_back(sqlite3_column_name(_stmt, i));
+        _columns = std::make_shared<schema>(names);
+    }
+
+    return _columns;
+}
+
+std::string statement::expanded_sql(void) const
+{
+    char *expanded = sqlite3_expanded_sql(_stmt);
+    if (expanded == NULL)
+        return "";
+
+    std::string out = expanded;
+    sqlite3_free(expanded);
+    return out;
+}
+
+std::string statement::bound_key(void) const
+{
+    auto out = expanded_sql();
+    if (out.empty() || _reals.empty())
+        return out;
+
+    out += '\0';
+    out += _reals;
+    return out;
+}
+
+int statement::step(void)
+{
+    return sqlite3_step(_stmt);
+}
+
+void statement::reset(void)
+{
+    sqlite3_reset(_stmt);
+    sqlite3_clear_bindings(_stmt);
+    _reals.clear();
+}
@@ -0,0 +1,95 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#ifndef PSQLITE__STATEMENT_HXX
+#define PSQLITE__STATEMENT_HXX
+
+#include <memory>
+#include "datum.h++"
+#include "schema.h++"
+#include <sqlite3.h>
+#include <stdint.h>
+#include <string>
+
+namespace psqlite {
+    /* Wraps a single prepared SQLite statement.  These are owned by
+     * a connection, which keeps them around so the same query
+     * doesn't need to be parsed over and over again. */
+    class statement {
+    public:
+        typedef std::shared_ptr<statement> ptr;
+
+    private:
+        sqlite3_stmt *_stmt;
+
+        /* The SQL text this statement was prepared from, which is
+         * also the key used to find it again. */
+        const std::string _sql;
+
+        /* Statements built from a fully formatted query string
+         * are unlikely to ever be seen again, so they don't get
+         * put back into the cache. */
+        const bool _cacheable;
+
+        /* What the query looks like without any of its arguments,
+         * which is the same as the SQL unless the arguments were
+         * escaped straight into it. */
+        std::string _shape;
+
+        /* The exact bit patterns of every REAL that's currently
+         * bound, as expanded_sql() rounds them. */
+        std::string _reals;
+
+        /* The names of the columns this statement returns, which
+         * are looked up the first time they're needed. */
+        schema::ptr _columns;
+
+    public:
+        /* Takes ownership of an already-prepared statement. */
+        statement(sqlite3_stmt *stmt,
+                  const std::string& sql,
+                  bool cacheable);
+
+        ~statement(void);
+
+    public:
+        sqlite3_stmt *handle(void) const { return _stmt; }
+        const std::string& sql(void) const { return _sql; }
+        bool cacheable(void) const { return _cacheable; }
+        const std::string& shape(void) const { return _shape; }
+        void set_shape(const std::string& shape) { _shape = shape; }
+
+        /* Returns the SQL with every bound parameter filled in, or
+         * an empty string if SQLite can't produce it. */
+        std::string expanded_sql(void) const;
+
+        /* Returns a string that's different for every distinct set
+         * of bound parameters.  This is expanded_sql() with the
+         * exact value of every REAL tacked on, as SQLite only
+         * prints 15 significant digits of them. */
+        std::string bound_key(void) const;
+
+        /* Returns the columns this statement produces.  These are
+         * shared by every row read from it. */
+        const schema::ptr& columns(void);
+
+        /* Binds a value to one of the statement's parameters.
+         * Note that SQLite numbers parameters starting at 1. */
+        void bind_text(int i, const char *text, size_t length);
+        void bind_text(int i, const std::string& text)
+            { bind_text(i, text.c_str(), text.size()); }
+        void bind_int64(int i, int64_t value);
+        void bind_double(int i, double value);
+        void bind_null(int i);
+        void bind(int i, const datum& value);
+
+        /* Steps the statement, returning the raw SQLite code. */
+        int step(void);
+
+        /* Resets the statement and drops all its bindings so it
+         * can be safely handed out again. */
+        void reset(void);
+    };
+}
+
+#endif
@@ -0,0 +1,64 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#include "statement_cache.h++"
+using namespace psqlite;
+
+statement_cache::statement_cache(size_t capacity)
+    : _capacity(capacity),
+      _lru(),
+      _index(),
+      _hits(0),
+      _misses(0)
+{
+}
+
+statement::ptr statement_cache::take(const std::string& sql)
+{
+    auto l = _index.find(sql);
+    if (l == _index.end()) {
+        _misses++;
+        return NULL;
+    }
+
+    auto out = *(l->second);
+    _lru.erase(l->second);
+    _index.erase(l);
+    _hits++;
+    return out;
+}
+
+void statement_cache::give(const statement::ptr& stmt)
+{
+    if (_capacity == 0)
+        return;
+
+    /* Someone else may have prepared the same query while this one
+     * was out, in which case there's no reason to keep both. */
+    if (_index.find(stmt->sql()) != _index.end())
+        return;
+
+    _lru.push_front(stmt);
+    _index[stmt->sql()] = _lru.begin();
+    evict();
+}
+
+void statement_cache::clear(void)
+{
+    _index.clear();
+    _lru.clear();
+}
+
+void statement_cache::resize(size_t capacity)
+{
+    _capacity = capacity;
+    evict();
+}
+
+void statement_cache::evict(void)
+{
+    while (_lru.size() > _capacity) {
+        _index.erase(_lru.back()->sql());
+        _lru.pop_back();
+    }
+}
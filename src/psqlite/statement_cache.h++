@@ -0,0 +1,61 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#ifndef PSQLITE__STATEMENT_CACHE_HXX
+#define PSQLITE__STATEMENT_CACHE_HXX
+
+#include <list>
+#include "statement.h++"
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+namespace psqlite {
+    /* A least-recently-used cache of prepared statements, keyed by
+     * the SQL text they were prepared from.  Statements are taken
+     * out of the cache while they're running and given back when
+     * they're done, so two users of the same query shape never
+     * end up sharing a single sqlite3_stmt. */
+    class statement_cache {
+    private:
+        size_t _capacity;
+
+        /* The most recently used statement lives at the front. */
+        std::list<statement::ptr> _lru;
+        std::unordered_map<std::string,
+                           std::list<statement::ptr>::iterator> _index;
+
+        uint64_t _hits;
+        uint64_t _misses;
+
+    public:
+        statement_cache(size_t capacity);
+
+    public:
+        /* Removes the statement that matches the given SQL from
+         * the cache, returning NULL if there isn't one (in which
+         * case it's up to the caller to go prepare it). */
+        statement::ptr take(const std::string& sql);
+
+        /* Returns a statement to the cache, possibly evicting the
+         * least recently used one.  The statement must already
+         * have been reset. */
+        void give(const statement::ptr& stmt);
+
+        /* Drops every cached statement. */
+        void clear(void);
+
+        /* Changes the maximum number of cached statements. */
+        void resize(size_t capacity);
+
+        size_t size(void) const { return _lru.size(); }
+        size_t capacity(void) const { return _capacity; }
+        uint64_t hits(void) const { return _hits; }
+        uint64_t misses(void) const { return _misses; }
+
+    private:
+        void evict(void);
+    };
+}
+
+#endif
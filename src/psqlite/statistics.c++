@@ -0,0 +1,164 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#include "statistics.h++"
+#include <string.h>
+using namespace psqlite;
+
+/* Escapes a string so it can be printed inside of a JSON string. */
+static std::string json_escape(const std::string& str);
+
+histogram::histogram(void)
+    : _count(0),
+      _sum(0),
+      _max(0)
+{
+    memset(_buckets, 0, sizeof(_buckets));
+}
+
+void histogram::add(uint64_t value)
+{
+    /* Bucket N holds values in [2^(N-1), 2^N). */
+    size_t bucket = 0;
+    while (bucket < 63 && (value >> bucket) != 0)
+        bucket++;
+
+    _buckets[bucket]++;
+    _count++;
+    _sum += value;
+    if (value > _max)
+        _max = value;
+}
+
+uint64_t histogram::quantile(double q) const
+{
+    if (_count == 0)
+        return 0;
+
+    uint64_t target = q * _count;
+    if (target >= _count)
+        target = _count - 1;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < 64; ++i) {
+        seen += _buckets[i];
+        if (seen > target) {
+            uint64_t bound = (i == 0) ? 0 : ((1ULL << i) - 1);
+            return (bound < _max) ? bound : _max;
+        }
+    }
+
+    return _max;
+}
+
+statistics::statistics(void)
+    : _lock(),
+      _queries(),
+      _busy_retries(0),
+      _transactions()
+{
+}
+
+void statistics::statement_finished(const std::string& sql,
+                                    const statement_profile& p)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    auto& q = _queries[sql];
+    q.latency.add(p.nanoseconds);
+    q.rows += p.rows;
+    q.fullscan_steps += p.fullscan_steps;
+    q.sorts += p.sorts;
+    q.autoindexes += p.autoindexes;
+    q.vm_steps += p.vm_steps;
+}
+
+void statistics::busy_retry(int count __attribute__((unused)))
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    _busy_retries++;
+}
+
+void statistics::transaction_finished(uint64_t nanoseconds)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    _transactions.add(nanoseconds);
+}
+
+std::map<std::string, statistics::query> statistics::queries(void) const
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    return _queries;
+}
+
+uint64_t statistics::busy_retries(void) const
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    return _busy_retries;
+}
+
+histogram statistics::transactions(void) const
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    return _transactions;
+}
+
+void statistics::clear(void)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    _queries.clear();
+    _busy_retries = 0;
+    _transactions = histogram();
+}
+
+void statistics::print(FILE *file) const
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    for (const auto& pair: _queries) {
+        const auto& q = pair.second;
+        fprintf(file,
+                "{\"sql\": \"%s\", \"runs\": %lu, \"total_ns\": %lu, "
+                "\"p50_ns\": %lu, \"p99_ns\": %lu, \"max_ns\": %lu, "
+                "\"rows\": %lu, \"fullscan_steps\": %lu, \"sorts\": %lu, "
+                "\"autoindexes\": %lu, \"vm_steps\": %lu}\n",
+                json_escape(pair.first).c_str(),
+                (unsigned long)q.latency.count(),
+                (unsigned long)q.latency.sum(),
+                (unsigned long)q.latency.quantile(0.50),
+                (unsigned long)q.latency.quantile(0.99),
+                (unsigned long)q.latency.max(),
+                (unsigned long)q.rows,
+                (unsigned long)q.fullscan_steps,
+                (unsigned long)q.sorts,
+                (unsigned long)q.autoindexes,
+                (unsigned long)q.vm_steps);
+    }
+
+    fprintf(file,
+            "{\"busy_retries\": %lu, \"transactions\": %lu, "
+            "\"transaction_p50_ns\": %lu, \"transaction_p99_ns\": %lu, "
+            "\"transaction_max_ns\": %lu}\n",
+            (unsigned long)_busy_retries,
+            (unsigned long)_transactions.count(),
+            (unsigned long)_transactions.quantile(0.50),
+            (unsigned long)_transactions.quantile(0.99),
+            (unsigned long)_transactions.max());
+}
+
+std::string json_escape(const std::string& str)
+{
+    std::string out;
+    for (const auto& c: str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            char buffer[8];
+            snprintf(buffer, 8, "\\u%04x", c);
+            out += buffer;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
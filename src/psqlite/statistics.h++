@@ -0,0 +1,98 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#ifndef PSQLITE__STATISTICS_HXX
+#define PSQLITE__STATISTICS_HXX
+
+#include <memory>
+#include "instrument.h++"
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+namespace psqlite {
+    /* A latency histogram with power-of-two buckets, which is cheap
+     * enough to update on every single query. */
+    class histogram {
+    private:
+        uint64_t _buckets[64];
+        uint64_t _count;
+        uint64_t _sum;
+        uint64_t _max;
+
+    public:
+        histogram(void);
+
+    public:
+        void add(uint64_t value);
+
+        uint64_t count(void) const { return _count; }
+        uint64_t sum(void) const { return _sum; }
+        uint64_t max(void) const { return _max; }
+
+        /* Returns an upper bound on the given quantile (between 0
+         * and 1), which is accurate to within a factor of two. */
+        uint64_t quantile(double q) const;
+    };
+
+    /* An instrument that aggregates everything it's told about by
+     * query shape, which is probably all you want unless you're
+     * exporting these somewhere else.  This is safe to share
+     * between connections (and therefore between threads). */
+    class statistics: public instrument {
+    public:
+        typedef std::shared_ptr<statistics> ptr;
+
+        /* Everything that's known about one query shape. */
+        struct query {
+            histogram latency;
+            uint64_t rows;
+            uint64_t fullscan_steps;
+            uint64_t sorts;
+            uint64_t autoindexes;
+            uint64_t vm_steps;
+
+            query(void)
+                : latency(),
+                  rows(0),
+                  fullscan_steps(0),
+                  sorts(0),
+                  autoindexes(0),
+                  vm_steps(0)
+                {
+                }
+        };
+
+    private:
+        mutable std::mutex _lock;
+        std::map<std::string, query> _queries;
+        uint64_t _busy_retries;
+        histogram _transactions;
+
+    public:
+        statistics(void);
+
+    public:
+        virtual void statement_finished(const std::string& sql,
+                                        const statement_profile& p);
+        virtual void busy_retry(int count);
+        virtual void transaction_finished(uint64_t nanoseconds);
+
+    public:
+        /* Returns copies of the current statistics. */
+        std::map<std::string, query> queries(void) const;
+        uint64_t busy_retries(void) const;
+        histogram transactions(void) const;
+
+        /* Forgets everything collected so far. */
+        void clear(void);
+
+        /* Writes out the statistics, as one line of JSON per query
+         * shape followed by one line for locking. */
+        void print(FILE *file) const;
+    };
+}
+
+#endif
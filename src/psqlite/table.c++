@@ -7,6 +7,16 @@ using namespace psqlite;
 table::table(const std::string& name,
              const std::vector<column::ptr>& cols)
     : _name(name),
-      _cols(cols)
+      _cols(cols),
+      _indexes()
+{
+}
+
+table::table(const std::string& name,
+             const std::vector<column::ptr>& cols,
+             const std::vector<table_index::ptr>& indexes)
+    : _name(name),
+      _cols(cols),
+      _indexes(indexes)
 {
 }
@@ -6,13 +6,14 @@
 
 #include <memory>
 #include "column.h++"
+#include "table_index.h++"
 #include <string>
 #include <vector>
 
 namespace psqlite {
     /* This represents a SQL table, which pretty much just
      * consists of a table name and a bunch of columns in some
-     * order. */
+     * order, along with any secondary indexes. */
     class table {
     public:
         typedef std::shared_ptr<table> ptr;
@@ -20,11 +21,15 @@ namespace psqlite {
     private:
         std::string _name;
         std::vector<column::ptr> _cols;
+        std::vector<table_index::ptr> _indexes;
 
     public:
         /* Creates a new column from a list of tables. */
         table(const std::string& name,
               const std::vector<column::ptr>& cols);
+        table(const std::string& name,
+              const std::vector<column::ptr>& cols,
+              const std::vector<table_index::ptr>& indexes);
 
     public:
         /* Returns the list of all columns in this table. */
@@ -33,6 +38,9 @@ namespace psqlite {
 
         const std::string& name(void) const
             { return _name; }
+
+        const std::vector<table_index::ptr>& indexes(void) const
+            { return _indexes; }
     };
 }
 
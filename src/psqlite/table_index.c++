@@ -0,0 +1,16 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#include "table_index.h++"
+using namespace psqlite;
+
+table_index::table_index(const std::string& name,
+                         const std::vector<std::string>& cols,
+                         bool unique,
+                         const std::string& where)
+    : _name(name),
+      _cols(cols),
+      _unique(unique),
+      _where(where)
+{
+}
@@ -0,0 +1,40 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#ifndef PSQLITE__TABLE_INDEX_HXX
+#define PSQLITE__TABLE_INDEX_HXX
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace psqlite {
+    /* A secondary index on a table, which can cover more than one
+     * column.  A partial index only covers the rows that match its
+     * WHERE clause, which is plain SQL (it's not a printf-style
+     * format like the rest of the WHERE clauses here). */
+    class table_index {
+    public:
+        typedef std::shared_ptr<table_index> ptr;
+
+    private:
+        const std::string _name;
+        const std::vector<std::string> _cols;
+        const bool _unique;
+        const std::string _where;
+
+    public:
+        table_index(const std::string& name,
+                    const std::vector<std::string>& cols,
+                    bool unique = false,
+                    const std::string& where = "");
+
+    public:
+        const std::string& name(void) const { return _name; }
+        const std::vector<std::string>& columns(void) const { return _cols; }
+        bool unique(void) const { return _unique; }
+        const std::string& where(void) const { return _where; }
+    };
+}
+
+#endif
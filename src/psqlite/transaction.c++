@@ -21,8 +21,11 @@ transaction::~transaction(void)
     case error_code::SUCCESS:
         break;
 
-        /* These error codes can't actually happen. */
+        /* These error codes can't actually happen, except for
+         * FAILED_BUSY -- which can't be reported from here. */
+    case error_code::FAILED_BUSY:
     case error_code::FAILED_UNIQUE:
+    case error_code::FAILED_MISSING_KEY:
         fprintf(stderr, "Error closing transaction: '%s'\n",
                 resp->return_string().c_str());
         abort();
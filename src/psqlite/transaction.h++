@@ -31,6 +31,11 @@ namespace psqlite {
 
         /* Closes a transaction, actually committing it. */
         virtual ~transaction(void);
+
+    public:
+        /* Returns the connection this transaction is running
+         * on. */
+        connection *conn(void) const { return _conn; }
     };
 
     class deferred_transaction: public transaction {
@@ -0,0 +1,155 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#include "write_queue.h++"
+using namespace psqlite;
+
+write_queue::write_queue(const connection_pool::ptr& pool,
+                         size_t max_batch,
+                         std::chrono::microseconds max_delay)
+    : _pool(pool),
+      _max_batch((max_batch == 0) ? 1 : max_batch),
+      _max_delay(max_delay),
+      _lock(),
+      _queued(),
+      _queue(),
+      _stopping(false),
+      _batches(0),
+      _writes(0),
+      _thread()
+{
+    _thread = std::thread(&write_queue::writer_main, this);
+}
+
+write_queue::~write_queue(void)
+{
+    {
+        std::unique_lock<std::mutex> lock(_lock);
+        _stopping = true;
+    }
+
+    _queued.notify_all();
+    _thread.join();
+}
+
+std::future<result::ptr> write_queue::insert(const table::ptr& table,
+                                             const row::ptr& row)
+{
+    return submit([=](const connection::ptr& conn)
+                  { return conn->insert(table, row); });
+}
+
+std::future<std::vector<error_code>>
+write_queue::insert_many(const table::ptr& table,
+                         const std::vector<row::ptr>& rows)
+{
+    return submit([=](const connection::ptr& conn)
+                  { return conn->insert_many(table, rows); });
+}
+
+std::future<std::vector<error_code>>
+write_queue::replace_many(const table::ptr& table,
+                          const std::vector<row::ptr>& rows,
+                          const std::vector<std::string>& keys)
+{
+    return submit([=](const connection::ptr& conn)
+                  { return conn->replace_many(table, rows, keys); });
+}
+
+uint64_t write_queue::batches(void)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    return _batches;
+}
+
+uint64_t write_queue::writes(void)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    return _writes;
+}
+
+void write_queue::enqueue(job::ptr j)
+{
+    j->queued = std::chrono::steady_clock::now();
+
+    {
+        std::unique_lock<std::mutex> lock(_lock);
+        _queue.push_back(std::move(j));
+    }
+
+    _queued.notify_one();
+}
+
+void write_queue::writer_main(void)
+{
+    std::unique_lock<std::mutex> lock(_lock);
+
+    while (true) {
+        _queued.wait(lock, [this]{ return _stopping || !_queue.empty(); });
+        if (_queue.empty())
+            return;
+
+        /* Gives everyone else a chance to add to this batch, unless
+         * it's already full or we're trying to shut down.  The delay
+         * counts from when the oldest write was queued, which may
+         * well have been while the last batch was committing. */
+        if (_max_delay.count() > 0) {
+            auto deadline = _queue.front()->queued + _max_delay;
+            _queued.wait_until(lock, deadline,
+                               [this]{
+                                   return _stopping
+                                       || _queue.size() >= _max_batch;
+                               });
+        }
+
+        std::vector<job::ptr> batch;
+        while (!_queue.empty() && batch.size() < _max_batch) {
+            batch.push_back(std::move(_queue.front()));
+            _queue.pop_front();
+        }
+
+        /* The queue stays open while the batch runs, which is where
+         * the next batch comes from. */
+        lock.unlock();
+
+        {
+            auto conn = _pool->writer();
+            {
+                /* The batch has nowhere to report a locked database,
+                 * so the writer just keeps waiting for it. */
+                auto tr = conn->immediate_transaction();
+                while (tr == NULL) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    tr = conn->immediate_transaction();
+                }
+                /* Every write gets its own savepoint, so one that
+                 * fails part way through doesn't leave anything
+                 * behind in the batch. */
+                for (const auto& j: batch) {
+                    conn->savepoint("write_queue_job");
+                    try {
+                        j->run(conn);
+                    } catch (...) {
+                        j->error = std::current_exception();
+                        conn->rollback_to_savepoint("write_queue_job");
+                    }
+                    conn->release_savepoint("write_queue_job");
+                }
+            }
+        }
+
+        /* The counters are updated first, so they're never behind
+         * what the futures say. */
+        lock.lock();
+        _batches++;
+        _writes += batch.size();
+        lock.unlock();
+
+        /* Nobody hears about their write until it's been committed,
+         * as otherwise it could still be lost. */
+        for (const auto& j: batch)
+            j->finish();
+
+        lock.lock();
+    }
+}
@@ -0,0 +1,187 @@
+/* Copyright (C) 2014 Palmer Dabbelt <palmer@dabbelt.com> */
+/* SPDX-License-Identifier: GPL-2.0+ OR Apache-2.0 OR BSD-3-Clause */
+
+#ifndef PSQLITE__WRITE_QUEUE_HXX
+#define PSQLITE__WRITE_QUEUE_HXX
+
+#include <memory>
+#include <chrono>
+#include <condition_variable>
+#include "connection_pool.h++"
+#include <deque>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+namespace psqlite {
+    /* Runs writes on a dedicated thread, so callers don't block on
+     * SQLite.  Every write is queued up and handed back a future,
+     * and the writer thread runs everything that's waiting as a
+     * single immediate transaction -- so a whole batch of writes
+     * from different callers shares one commit (and one fsync).
+     * A future doesn't become ready until its write has actually
+     * been committed.
+     *
+     * Reads shouldn't go through here: they should use one of the
+     * pool's readers, which (as the pool is in WAL mode) never wait
+     * on the writer. */
+    class write_queue {
+    public:
+        typedef std::shared_ptr<write_queue> ptr;
+
+    private:
+        /* A single queued write, which is run inside the batch's
+         * transaction and then finished once the batch has been
+         * committed. */
+        class job {
+        public:
+            typedef std::unique_ptr<job> ptr;
+
+            /* When the job was queued, which is what the batch
+             * delay is measured from. */
+            std::chrono::steady_clock::time_point queued;
+
+            /* Anything the job threw, which is handed back through
+             * its future rather than taking down the writer. */
+            std::exception_ptr error;
+
+            virtual ~job(void) {}
+            virtual void run(const connection::ptr& conn) = 0;
+            virtual void finish(void) = 0;
+        };
+
+        template<class T, class F> class job_t: public job {
+        private:
+            F _op;
+            std::promise<T> _promise;
+            std::unique_ptr<T> _value;
+
+        public:
+            job_t(const F& op)
+                : _op(op),
+                  _promise(),
+                  _value()
+                {
+                }
+
+        public:
+            std::future<T> get_future(void)
+                { return _promise.get_future(); }
+            void run(const connection::ptr& conn)
+                { _value.reset(new T(_op(conn))); }
+            void finish(void)
+                {
+                    if (error != NULL)
+                        _promise.set_exception(error);
+                    else
+                        _promise.set_value(std::move(*_value));
+                }
+        };
+
+        template<class F> class job_t<void, F>: public job {
+        private:
+            F _op;
+            std::promise<void> _promise;
+
+        public:
+            job_t(const F& op)
+                : _op(op),
+                  _promise()
+                {
+                }
+
+        public:
+            std::future<void> get_future(void)
+                { return _promise.get_future(); }
+            void run(const connection::ptr& conn)
+                { _op(conn); }
+            void finish(void)
+                {
+                    if (error != NULL)
+                        _promise.set_exception(error);
+                    else
+                        _promise.set_value();
+                }
+        };
+
+    private:
+        const connection_pool::ptr _pool;
+        const size_t _max_batch;
+        const std::chrono::microseconds _max_delay;
+
+        /* Protects everything below. */
+        std::mutex _lock;
+        std::condition_variable _queued;
+        std::deque<job::ptr> _queue;
+        bool _stopping;
+        uint64_t _batches;
+        uint64_t _writes;
+
+        /* This has to come last, so everything above has been
+         * constructed before the thread starts using it. */
+        std::thread _thread;
+
+    public:
+        /* Starts a writer thread that uses the pool's writer.  The
+         * writer thread commits a batch as soon as "max_batch"
+         * writes are waiting, or once the oldest write has waited
+         * "max_delay".  A delay of zero doesn't wait at all, but
+         * writes still get grouped together as they pile up behind
+         * the commit that's running. */
+        write_queue(const connection_pool::ptr& pool,
+                    size_t max_batch = 256,
+                    std::chrono::microseconds max_delay = std::chrono::microseconds(0));
+
+        /* Commits everything that's still queued before stopping
+         * the writer thread. */
+        ~write_queue(void);
+
+    public:
+        /* Queues up an arbitrary write.  "op" is called with the
+         * writer connection while a transaction is open, so it must
+         * not start a transaction of its own, and its return value
+         * is handed back through the future.  If it throws then
+         * everything it wrote is rolled back, so a failed op leaves
+         * no changes behind, and the exception goes to the future
+         * instead.  The rest of the batch is still committed. */
+        template<class F>
+        auto submit(const F& op)
+            -> std::future<decltype(op(std::declval<connection::ptr>()))>
+            {
+                typedef decltype(op(std::declval<connection::ptr>())) T;
+                auto j = new job_t<T, F>(op);
+                auto out = j->get_future();
+                enqueue(job::ptr(j));
+                return out;
+            }
+
+        /* Queued versions of the connection's write operations.
+         * The printf-style ones can't be queued safely (as their
+         * arguments may be gone by the time they run), so they'll
+         * have to go through submit(). */
+        std::future<result::ptr> insert(const table::ptr& table,
+                                        const row::ptr& row);
+        std::future<std::vector<error_code>> insert_many(const table::ptr& table,
+                                                         const std::vector<row::ptr>& rows);
+        std::future<std::vector<error_code>> replace_many(const table::ptr& table,
+                                                          const std::vector<row::ptr>& rows,
+                                                          const std::vector<std::string>& keys);
+
+        /* Checks out a reader from the underlying pool. */
+        connection::ptr reader(void) { return _pool->reader(); }
+
+        /* The number of batches committed, and the number of writes
+         * they contained. */
+        uint64_t batches(void);
+        uint64_t writes(void);
+
+    private:
+        void enqueue(job::ptr j);
+        void writer_main(void);
+    };
+}
+
+#endif